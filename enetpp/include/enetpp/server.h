@@ -115,6 +115,18 @@ namespace enetpp {
 			}
 		}
 
+		//for packets the caller built in place with enet_packet_create(nullptr, ...). takes ownership of the packet.
+		void send_packet_to(unsigned int client_id, enet_uint8 channel_id, ENetPacket* packet) {
+			assert(is_listening());
+			if (_thread != nullptr) {
+				std::lock_guard<std::mutex> lock(_packet_queue_mutex);
+				_packet_queue.emplace(channel_id, packet, client_id);
+			}
+			else {
+				enet_packet_destroy(packet);
+			}
+		}
+
 		void send_packet_to_all_if(enet_uint8 channel_id, const enet_uint8* data, size_t data_size, enet_uint32 flags, std::function<bool(const ClientT& client)> predicate) {
 			assert(is_listening());
 			if (_thread != nullptr) {
@@ -8,6 +8,9 @@ local VoxelWorldInitChannel = runtime.oop.create("VoxelWorldInitChannel")
 exports.VoxelWorldInitChannel = VoxelWorldInitChannel
 runtime.oop.extend(VoxelWorldInitChannel,NetworkChannel)
 
+-- How much compressed chunk data each player gets sent per tick, while joining or walking into chunks they haven't seen
+local STREAM_BYTES_PER_TICK = 128 * 1024
+
 local P = {
 	VOXELATE_WORLD_CONFIG = 1,
 	VOXELATE_WORLD_CHUNK_STARTUP = 2,
@@ -103,25 +106,34 @@ function VoxelWorldInitChannel:SendVoxelStartupChunks(peerID,worldID,buffer)
 
 	if not IsValid(ply) then return end
 
-	local function chunkSenderThread()
-		self.voxelate.io:PrintDebug("Sending chunk initialisation data for %d to %d...",worldID,peerID)
+	local module = self.voxelate.module
+	local ent = config.sourceEngineEntity
+
+	self.voxelate.io:PrintDebug("Sending chunk initialisation data for %d to %d...",worldID,peerID)
+
+	-- The module keeps track of what the player can see and packs the chunks, we just keep it fed with where the player is, once a tick.
+	-- This keeps going for as long as they're around, worlds with a viewRadius send and unload chunks as they move.
+	module.voxStreamStart(worldID,peerID,ent:WorldToLocal(ply:GetPos()))
 
-		local chunk_positions = self.voxelate.module.voxGetAllChunks(worldID, config.sourceEngineEntity:WorldToLocal(ply:GetPos()))
-		while #chunk_positions>0 do
-			local p = chunk_positions[1]
-			table.remove(chunk_positions, 1) -- yes i know this is bad
+	local startupDone = false
+
+	local function streamChunks()
+		if not IsValid(ent) or not IsValid(ply) or self.voxelate.router.PeerIDs[peerID] ~= ply then
+			module.voxStreamStop(worldID,peerID)
+			return
+		end
 
-			self.voxelate.module.voxSendChunk(worldID,peerID,p.x,p.y,p.z)
+		local remaining = module.voxStreamUpdate(worldID,peerID,ent:WorldToLocal(ply:GetPos()),STREAM_BYTES_PER_TICK)
 
-			timer.Simple(0,chunkSenderThread)
-			coroutine.yield()
+		if remaining == 0 and not startupDone then
+			startupDone = true
+			self.voxelate.io:PrintDebug("Chunk initialisation data sent to %d...",peerID)
 		end
 
-		self.voxelate.io:PrintDebug("Chunk initialisation data sent to %d...",peerID)
+		timer.Simple(0,streamChunks)
 	end
 
-	chunkSenderThread = coroutine.wrap(chunkSenderThread) -- create thread
-	chunkSenderThread() -- launch thread
+	streamChunks()
 end
 
 function VoxelWorldInitChannel:OnIncomingPacket(packet)
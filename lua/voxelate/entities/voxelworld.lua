@@ -3,6 +3,9 @@ local runtime,exports = ...
 local CreateSourceEngineSubEntity = runtime.require("./voxelentity/source_engine").CreateEntity
 local CreateVoxelateEngineSubEntity = runtime.require("./voxelentity/voxelate_engine").CreateEntity
 
+-- source maps can't go past +-16384 units anyway
+local HUGE_WORLD_BOUNDS = 16384
+
 local ENT = {}
 
 ENT.Type = "anim"
@@ -84,6 +87,13 @@ function ENT:SetupBounds(config)
 	local mins = Vector(0,0,0)
 	local maxs = dims*scale
 
+	-- huge worlds go on forever, as far as the engine is concerned that's the whole map
+	if config.huge then
+		mins = Vector(-1,-1,-1)*HUGE_WORLD_BOUNDS
+		maxs = Vector(1,1,1)*HUGE_WORLD_BOUNDS
+	end
+
+	self.correct_mins = mins
 	self.correct_maxs = maxs
 
 	self:SetCollisionBounds(mins,maxs)
@@ -95,9 +105,20 @@ end
 function ENT:Think()
 	local index = self:GetInternalIndex()
 
-	-- 100 updates per frame is -SERIOUSLY- excessive
+	-- meshing happens on worker threads, this is how many milliseconds per frame we spend uploading finished meshes
 	-- the entire point of queueing updates is so we dont lag balls
-	gm_voxelate.module.voxUpdate(index,20,self)
+	gm_voxelate.module.voxUpdate(index,2,self)
+
+	-- everything edited this tick goes out in one packet per chunk
+	if SERVER and gm_voxelate.module.voxFlushEdits(index) then
+		for peerID,_ in pairs(gm_voxelate.router.PeerIDs) do
+			gm_voxelate.module.voxSendEdits(index,peerID)
+		end
+	end
+
+	if SERVER then
+		self:UpdatePersistence()
+	end
 
 	if CLIENT then
 		if not self.correct_maxs then
@@ -108,9 +129,9 @@ function ENT:Think()
 			end
 		else
 			-- bounds are set up, see if they need fixed.
-			local _,maxs = self:GetRenderBounds()
-			if maxs~=self.correct_maxs then
-				self:SetRenderBounds(Vector(),self.correct_maxs)
+			local mins,maxs = self:GetRenderBounds()
+			if mins~=self.correct_mins or maxs~=self.correct_maxs then
+				self:SetRenderBounds(self.correct_mins,self.correct_maxs)
 				print("Corrected render bounds on Voxel System #"..index..".")
 			end
 		end
@@ -154,6 +175,13 @@ function ENT:TestCollision(start,delta,isbox,extents)
 	end
 end
 
+-- Lots of traces in one call, in local coordinates. traces is a string or UCHARPTR of packed floats,
+-- see voxTraceMany in vox_lua_bridge.cpp for the layout.
+function ENT:TraceMany(traces,isbox,extents,parallel)
+	local index = self:GetInternalIndex()
+	return gm_voxelate.module.voxTraceMany(index,traces,isbox,extents,parallel)
+end
+
 function ENT:CreateSubEntity(className)
 	-- negative indexes are clientside-created ents
 	-- positive indexes are serverside-created ents
@@ -196,9 +224,7 @@ if SERVER then
 	function ENT:setBlock(x,y,z,d)
 		local index = self:GetInternalIndex()
 
-		local success = gm_voxelate.module.voxSet(index,x,y,z,d)
-		if success then gm_voxelate.channels.blockUpdate:SendBlockUpdate(index,x,y,z,d) end
-		return success
+		return gm_voxelate.module.voxSet(index,x,y,z,d) or false
 	end
 
 	function ENT:getAt(pos)
@@ -215,10 +241,8 @@ if SERVER then
 		self:setBlock(rel_pos.x,rel_pos.y,rel_pos.z,d)
 	end
 
-	-- TODO: implement voxSetRegion in C++ so we can network it separately/faster/efficiently
 	function ENT:setRegion(x,y,z,sx,sy,sz,d) --allow d to be string data
 		local index = self:GetInternalIndex()
-		local set = gm_voxelate.module.voxSet
 
 		local fix = math.floor
 
@@ -229,18 +253,7 @@ if SERVER then
 		sy = fix(sy)
 		sz = fix(sz)
 
-		local success = false
-
-		for ix=x,x+sx do
-			for iy=y,y+sy do
-				for iz=z,z+sz do
-					success = set(index,ix,iy,iz,d) or success
-				end
-			end
-		end
-
-		if success then gm_voxelate.channels.blockUpdate:SendBulkCuboidUpdate(index,x,y,z,sx,sy,sz,d) end
-		return success
+		return gm_voxelate.module.voxSetRegion(index,x,y,z,sx,sy,sz,d) or false
 	end
 
 	function ENT:setRegionAt(v1,v2,d)
@@ -258,7 +271,6 @@ if SERVER then
 
 	function ENT:setSphere(x,y,z,r,d)
 		local index = self:GetInternalIndex()
-		local set = gm_voxelate.module.voxSet
 
 		local fix = math.floor
 
@@ -267,24 +279,7 @@ if SERVER then
 		z = fix(z)
 		r = fix(r)
 
-		local success = false
-
-		local rsqr = r*r
-		for ix=x-r,x+r do
-			local xsqr = (ix-x)*(ix-x)
-			for iy=y-r,y+r do
-				local xysqr = xsqr+(iy-y)*(iy-y)
-				for iz=z-r,z+r do
-					local xyzsqr = xysqr+(iz-z)*(iz-z)
-					if xyzsqr<=rsqr then
-						success = set(index,ix,iy,iz,d) or success
-					end
-				end
-			end
-		end
-
-		if success then gm_voxelate.channels.blockUpdate:SendBulkSphereUpdate(index,x,y,z,r,d) end
-		return success
+		return gm_voxelate.module.voxSetSphere(index,x,y,z,r,d) or false
 	end
 
 	function ENT:setSphereAt(pos,r,d)
@@ -296,25 +291,52 @@ if SERVER then
 		self:setSphere(pos.x,pos.y,pos.z,r,d)
 	end
 
-	function ENT:save(file_name)
-		local serialized = gm_voxelate.module.voxSaveToString1(self:GetInternalIndex())
+	-- Saves are a directory of region files under data/. Only chunks that changed since the last save get written.
+	-- Saving and loading happen in the background, these just start them. Returns false if one is already running.
+	-- Progress goes out through the VoxelatePersistProgress hook, and VoxelateSaveFinished / VoxelateLoadFinished when done.
+	function ENT:save(dir_name)
+		file.CreateDir(dir_name)
 
-		if serialized then
-			file.Write(file_name,serialized)
-			return true
-		end
+		return gm_voxelate.module.voxSave(self:GetInternalIndex(),dir_name)
 	end
 
-	function ENT:load(file_name)
-		local f = file.Open(file_name,"rb","DATA")
-		if not f then return false end
+	function ENT:load(dir_name)
+		if not file.IsDir(dir_name,"DATA") then return false end
 
-		local serialized = f:Read(f:Size())
-		f:Close()
+		return gm_voxelate.module.voxLoad(self:GetInternalIndex(),dir_name)
+	end
+
+	-- Saves to dir_name every interval seconds. Only changed chunks get written, so this is cheap. nil to stop.
+	function ENT:setAutosave(dir_name,interval)
+		self.autosave_dir = dir_name
+		self.autosave_interval = interval
+		self.next_autosave = dir_name and CurTime()+interval
+	end
 
-		if not serialized then return false end
+	function ENT:UpdatePersistence()
+		local kind,done,total,finished,ok,loaded = gm_voxelate.module.voxPersistStatus(self:GetInternalIndex())
 
-		return gm_voxelate.module.voxLoadFromString1(self:GetInternalIndex(),serialized)
+		if kind and done~=self.persist_done then
+			self.persist_done = done
+			hook.Run("VoxelatePersistProgress",self,kind,done,total)
+		end
+
+		if finished then
+			self.persist_done = nil
+
+			if kind=="save" then
+				hook.Run("VoxelateSaveFinished",self,ok)
+			else
+				hook.Run("VoxelateLoadFinished",self,ok,loaded)
+			end
+		end
+
+		if self.autosave_dir and CurTime()>=self.next_autosave then
+			-- if the last one is still going, just try again next tick
+			if self:save(self.autosave_dir) then
+				self.next_autosave = CurTime()+self.autosave_interval
+			end
+		end
 	end
 end
 
@@ -4,7 +4,6 @@ local ClientRouter = runtime.require("./networking/client").Router
 local ServerRouter = runtime.require("./networking/server").Router
 
 local VoxelWorldInitChannel = runtime.require("./channels/voxelworldinit").VoxelWorldInitChannel
-local BlockUpdateChannel = runtime.require("./channels/blockupdate").BlockUpdateChannel
 --local BulkUpdateChannel = runtime.require("./channels/bulkupdate").BulkUpdateChannel
 
 runtime.require("./entities/voxelworld")
@@ -81,7 +80,6 @@ function Voxelate:__ctor()
 	end)]]
 
 	self:AddChannel(VoxelWorldInitChannel,"voxelWorldInit",2)
-	self:AddChannel(BlockUpdateChannel,"blockUpdate",3)
 	--self:AddChannel(BulkUpdateChannel,"bulkUpdate",4)
 end
 
@@ -23,6 +23,11 @@ newoption({
 	description = "Exposes a seriously dangerous read-any-file-on-OS function to Lua."
 })
 
+newoption({
+	trigger = "naivemesher",
+	description = "Meshes chunks with the old SliceFace merge loop instead of the bitmask one. For comparing the two."
+})
+
 if _OPTIONS.autoinstall and os.target() ~= "windows" then
 	error("Autoinstall is windows only right now thanks.")
 end
@@ -142,6 +147,10 @@ CreateWorkspace({name = "voxelate"})
 			defines({"VOXELATE_LUA_HOTLOADING"})
 		end
 
+		if _OPTIONS.naivemesher then
+			defines({"VOXELATE_NAIVE_MESHER"})
+		end
+
 	CreateProject({serverside = false})
 		language("C++11")
 
@@ -172,6 +181,50 @@ CreateWorkspace({name = "voxelate"})
 			defines({"VOXELATE_LUA_HOTLOADING"})
 		end
 
+		if _OPTIONS.naivemesher then
+			defines({"VOXELATE_NAIVE_MESHER"})
+		end
+
+	-- Standalone benchmark, see source/bench/vox_bench.cpp. Runs the mesher, traces and chunk compression
+	-- against stub engine sinks, so it needs the SDK headers but not a running game.
+	-- Builds both the server and client networking code, which talk over a loopback in source/bench/vox_bench_net.cpp.
+	project("voxelate_bench")
+		kind("ConsoleApp")
+		language("C++11")
+
+		defines({"IS_SERVERSIDE=true","VOXELATE_SERVER","VOXELATE_CLIENT"})
+
+		files({
+			"../source/bench/*.h",
+			"../source/bench/*.cpp",
+			"../source/vox_voxelworld.cpp",
+			"../source/vox_mesher.cpp",
+			"../source/vox_meshpool.cpp",
+			"../source/vox_blockstorage.cpp",
+			"../source/vox_chunkindex.cpp",
+			"../source/vox_chunkstream.cpp",
+			"../source/vox_codec.cpp",
+			"../source/vox_persist.cpp",
+			"../source/vox_regionfile.cpp",
+			"../source/vox_threadpool.cpp",
+			"../source/vox_worldgen.cpp",
+			"../source/vox_worldgen_basic.cpp",
+			"../source/collisionutils.cpp",
+		})
+		includedirs({"../source","../fastlz","../enet/include","../enetpp/include"})
+		links({"fastlz","enet"})
+
+		IncludeLuaShared()
+		IncludeSDKCommon()
+		IncludeSDKTier0()
+		IncludeSDKTier1()
+		IncludeSDKMathlib()
+
+		filter("system:linux")
+			links({"pthread"})
+
+		filter({})
+
 	project("fastlz")
 		language("C")
 		kind("StaticLib")
@@ -0,0 +1,968 @@
+// Standalone benchmark for the hot paths that normally only run inside gmod:
+// chunk meshing (both meshers, render and physics), vertex/triangle emission, traces and chunk compression (every codec).
+// Also streams a world to a client world over a loopback network, to check they end up the same (see vox_bench_net.h).
+// Everything is seeded, so two runs over the same build see exactly the same voxels and rays.
+//
+// Usage: voxelate_bench [-i mesh_iterations] [-t traces] [-s world_size] [scenario ...]
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "vox_voxelworld.h"
+#include "vox_mesher.h"
+#include "vox_worldgen_basic.h"
+#include "vox_worldgen.h"
+
+#include "vox_bench_net.h"
+
+typedef std::chrono::steady_clock BenchClock;
+
+static double secondsSince(BenchClock::time_point start) {
+	return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+// Stands in for CMeshBuilder. Stores the same attributes as VOXEL_VERT_FMT so the writes can't be optimized out.
+struct BenchMeshBuilder {
+	struct Vertex {
+		float pos[3];
+		unsigned char color[4];
+	};
+
+	std::vector<Vertex> verts;
+	Vertex current;
+
+	void Position3f(float x, float y, float z) {
+		current.pos[0] = x;
+		current.pos[1] = y;
+		current.pos[2] = z;
+	}
+
+	void Color4ub(unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
+		current.color[0] = r;
+		current.color[1] = g;
+		current.color[2] = b;
+		current.color[3] = a;
+	}
+
+	void AdvanceVertex() {
+		verts.push_back(current);
+	}
+};
+
+// Same for the old float format, see emitQuadVerticesFloat.
+struct BenchFloatMeshBuilder {
+	struct Vertex {
+		float pos[3];
+		float normal[3];
+		float texcoord[2][2];
+	};
+
+	std::vector<Vertex> verts;
+	Vertex current;
+
+	void Position3f(float x, float y, float z) {
+		current.pos[0] = x;
+		current.pos[1] = y;
+		current.pos[2] = z;
+	}
+
+	void Normal3f(float x, float y, float z) {
+		current.normal[0] = x;
+		current.normal[1] = y;
+		current.normal[2] = z;
+	}
+
+	void TexCoord2f(int stage, float s, float t) {
+		current.texcoord[stage][0] = s;
+		current.texcoord[stage][1] = t;
+	}
+
+	void AdvanceVertex() {
+		verts.push_back(current);
+	}
+};
+
+// What voxels_vs20.fxc makes of a compact vertex, minus the matrices. tile_size is one atlas tile in texture space.
+// Same math as the shader, keep them in sync!
+static void decodeCompactVertex(const float pos[3], const unsigned char color[4], const float tile_size[2],
+	float normal[3], float uv[2], float tile_base[2]) {
+
+	// +X, +Y, +Z, then -X, -Y, -Z
+	float dir = color[0];
+	float negative = 3.5f < dir;
+	float axis = dir - 3 * negative;
+
+	float on_axis[3];
+	on_axis[0] = axis < 1.5f;
+	on_axis[2] = 2.5f < axis;
+	on_axis[1] = 1 - on_axis[0] - on_axis[2];
+
+	float side = 1 - 2 * negative;
+
+	for (int i = 0; i < 3; i++)
+		normal[i] = on_axis[i] * side;
+
+	// Only the fractional part matters to the pixel shader, the 16 keeps it from going negative
+	uv[0] = 16 + side * (on_axis[0] * pos[1] - on_axis[1] * pos[0]) + on_axis[2] * pos[0];
+	uv[1] = 16 - (pos[2] + on_axis[2] * (pos[1] - pos[2]));
+
+	tile_base[0] = color[1] * tile_size[0];
+	tile_base[1] = color[2] * tile_size[1];
+}
+
+// The old 56 byte format, with world positions, normals and per-quad texture coordinates.
+// Nothing draws this anymore, it's only kept around to check the compact format against. Always emits 4 verts.
+static void emitQuadVerticesFloat(BenchFloatMeshBuilder& builder, const VoxelQuad& quad, const VoxelConfig& config, const XYZCoordinate& chunk_pos) {
+	double realStep = config.scale;
+
+	double uMin = ((double)quad.tx / config.atlasWidth) + config._padding_x;
+
+	double vMin = ((double)quad.ty / config.atlasHeight) + config._padding_y;
+
+	double realX;
+	double realY;
+	double realZ;
+
+	switch (quad.dir) {
+
+	case DIR_X_POS:
+
+		realX = (quad.slice + chunk_pos[0]*VOXEL_CHUNK_SIZE) * config.scale;
+		realY = (quad.x + chunk_pos[1]*VOXEL_CHUNK_SIZE) * config.scale;
+		realZ = (quad.y + chunk_pos[2]*VOXEL_CHUNK_SIZE) * config.scale;
+
+		builder.Position3f(realX + realStep, realY, realZ);
+		builder.TexCoord2f(0, 0, quad.h);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(1, 0, 0);
+		builder.AdvanceVertex();
+
+		builder.Position3f(realX + realStep, realY, realZ + realStep * quad.h);
+		builder.TexCoord2f(0, 0, 0);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(1, 0, 0);
+		builder.AdvanceVertex();
+
+		builder.Position3f(realX + realStep, realY + realStep * quad.w, realZ + realStep * quad.h);
+		builder.TexCoord2f(0, quad.w, 0);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(1, 0, 0);
+		builder.AdvanceVertex();
+
+		builder.Position3f(realX + realStep, realY + realStep * quad.w, realZ);
+		builder.TexCoord2f(0, quad.w, quad.h);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(1, 0, 0);
+		builder.AdvanceVertex();
+		
+		break;
+
+	case DIR_X_NEG:
+
+		realX = (quad.slice + chunk_pos[0]*VOXEL_CHUNK_SIZE) * config.scale;
+		realY = (quad.x + chunk_pos[1]*VOXEL_CHUNK_SIZE) * config.scale;
+		realZ = (quad.y + chunk_pos[2]*VOXEL_CHUNK_SIZE) * config.scale;
+
+		builder.Position3f(realX + realStep, realY, realZ);
+		builder.TexCoord2f(0, quad.w, quad.h);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(-1, 0, 0);
+		builder.AdvanceVertex();
+
+		builder.Position3f(realX + realStep, realY + realStep * quad.w, realZ);
+		builder.TexCoord2f(0, 0, quad.h);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(-1, 0, 0);
+		builder.AdvanceVertex();
+
+		builder.Position3f(realX + realStep, realY + realStep * quad.w, realZ + realStep * quad.h);
+		builder.TexCoord2f(0, 0, 0);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(-1, 0, 0);
+		builder.AdvanceVertex();
+
+		builder.Position3f(realX + realStep, realY, realZ + realStep * quad.h);
+		builder.TexCoord2f(0, quad.w, 0);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(-1, 0, 0);
+		builder.AdvanceVertex();
+		
+		break;
+
+	case DIR_Y_POS:
+
+		realX = (quad.x + chunk_pos[0]*VOXEL_CHUNK_SIZE) * config.scale;
+		realY = (quad.slice + chunk_pos[1]*VOXEL_CHUNK_SIZE) * config.scale;
+		realZ = (quad.y + chunk_pos[2]*VOXEL_CHUNK_SIZE) * config.scale;
+
+		builder.Position3f(realX, realY + realStep, realZ);
+		builder.TexCoord2f(0, quad.w, quad.h);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(0, 1, 0);
+		builder.AdvanceVertex();
+
+		builder.Position3f(realX + realStep * quad.w, realY + realStep, realZ);
+		builder.TexCoord2f(0, 0, quad.h);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(0, 1, 0);
+		builder.AdvanceVertex();
+
+		builder.Position3f(realX + realStep * quad.w, realY + realStep, realZ + realStep * quad.h);
+		builder.TexCoord2f(0, 0, 0);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(0, 1, 0);
+		builder.AdvanceVertex();
+
+		builder.Position3f(realX, realY + realStep, realZ + realStep * quad.h);
+		builder.TexCoord2f(0, quad.w, 0);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(0, 1, 0);
+		builder.AdvanceVertex();
+
+		break;
+	
+	case DIR_Y_NEG:
+
+		realX = (quad.x + chunk_pos[0]*VOXEL_CHUNK_SIZE) * config.scale;
+		realY = (quad.slice + chunk_pos[1]*VOXEL_CHUNK_SIZE) * config.scale;
+		realZ = (quad.y + chunk_pos[2]*VOXEL_CHUNK_SIZE) * config.scale;
+
+		builder.Position3f(realX, realY + realStep, realZ);
+		builder.TexCoord2f(0, 0, quad.h);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(0, -1, 0);
+		builder.AdvanceVertex();
+
+		builder.Position3f(realX, realY + realStep, realZ + realStep * quad.h);
+		builder.TexCoord2f(0, 0, 0);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(0, -1, 0);
+		builder.AdvanceVertex();
+
+		builder.Position3f(realX + realStep * quad.w, realY + realStep, realZ + realStep * quad.h);
+		builder.TexCoord2f(0, quad.w, 0);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(0, -1, 0);
+		builder.AdvanceVertex();
+
+		builder.Position3f(realX + realStep * quad.w, realY + realStep, realZ);
+		builder.TexCoord2f(0, quad.w, quad.h);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(0, -1, 0);
+		builder.AdvanceVertex();
+
+		break;
+
+	case DIR_Z_POS:
+
+		realX = (quad.x + chunk_pos[0]*VOXEL_CHUNK_SIZE) * config.scale;
+		realY = (quad.y + chunk_pos[1]*VOXEL_CHUNK_SIZE) * config.scale;
+		realZ = (quad.slice + chunk_pos[2]*VOXEL_CHUNK_SIZE) * config.scale;
+
+		builder.Position3f(realX, realY, realZ + realStep);
+		builder.TexCoord2f(0, 0, quad.h);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(0, 0, 1);
+		builder.AdvanceVertex();
+
+		builder.Position3f(realX, realY + realStep * quad.h, realZ + realStep);
+		builder.TexCoord2f(0, 0, 0);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(0, 0, 1);
+		builder.AdvanceVertex();
+
+		builder.Position3f(realX + realStep * quad.w, realY + realStep * quad.h, realZ + realStep);
+		builder.TexCoord2f(0, quad.w, 0);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(0, 0, 1);
+		builder.AdvanceVertex();
+
+		builder.Position3f(realX + realStep * quad.w, realY, realZ + realStep);
+		builder.TexCoord2f(0, quad.w, quad.h);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(0, 0, 1);
+		builder.AdvanceVertex();
+
+		break;
+
+	case DIR_Z_NEG:
+
+		realX = (quad.x + chunk_pos[0]*VOXEL_CHUNK_SIZE) * config.scale;
+		realY = (quad.y + chunk_pos[1]*VOXEL_CHUNK_SIZE) * config.scale;
+		realZ = (quad.slice + chunk_pos[2]*VOXEL_CHUNK_SIZE) * config.scale;
+
+		builder.Position3f(realX, realY, realZ + realStep);
+		builder.TexCoord2f(0, 0, quad.h);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(0, 0, -1);
+		builder.AdvanceVertex();
+
+		builder.Position3f(realX + realStep * quad.w, realY, realZ + realStep);
+		builder.TexCoord2f(0, quad.w, quad.h);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(0, 0, -1);
+		builder.AdvanceVertex();
+
+		builder.Position3f(realX + realStep * quad.w, realY + realStep * quad.h, realZ + realStep);
+		builder.TexCoord2f(0, quad.w, 0);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(0, 0, -1);
+		builder.AdvanceVertex();
+
+		builder.Position3f(realX, realY + realStep * quad.h, realZ + realStep);
+		builder.TexCoord2f(0, 0, 0);
+		builder.TexCoord2f(1, uMin, vMin);
+		builder.Normal3f(0, 0, -1);
+		builder.AdvanceVertex();
+
+		break;
+	}
+}
+
+// Stands in for an IPhysicsCollision polysoup.
+struct BenchPolysoup {
+	std::vector<Vector> verts;
+
+	void addTriangle(const Vector& v1, const Vector& v2, const Vector& v3) {
+		verts.push_back(v1);
+		verts.push_back(v2);
+		verts.push_back(v3);
+	}
+};
+
+struct BenchScenario {
+	const char* name;
+	const char* description;
+	BlockData (*generate)(Coord x, Coord y, Coord z, std::mt19937& rng);
+};
+
+static BlockData genWorldgen(Coord x, Coord y, Coord z, std::mt19937& rng) {
+	return vox_worldgen_basic(x, y, z);
+}
+
+static BlockData genNoise(Coord x, Coord y, Coord z, std::mt19937& rng) {
+	// Half air, the rest spread over all the solid types
+	std::uint32_t r = rng();
+	return (r & 1) ? 1 + (r >> 1) % 8 : 0;
+}
+
+static BlockData genCheckerboard(Coord x, Coord y, Coord z, std::mt19937& rng) {
+	// Every solid voxel shows all six faces and nothing merges. Worst case for the mesher.
+	return ((x + y + z) & 1) ? 1 : 0;
+}
+
+static BlockData genEmpty(Coord x, Coord y, Coord z, std::mt19937& rng) {
+	return 0;
+}
+
+static BlockData genSolid(Coord x, Coord y, Coord z, std::mt19937& rng) {
+	return 1;
+}
+
+static const BenchScenario scenarios[] = {
+	{ "worldgen", "vox_worldgen_basic terrain", genWorldgen },
+	{ "noise", "random types, 50% air", genNoise },
+	{ "checkerboard", "alternating air/solid, no merging", genCheckerboard },
+	{ "empty", "all air", genEmpty },
+	{ "solid", "all solid", genSolid }
+};
+
+struct BenchSettings {
+	int mesh_iterations = 20;
+	int traces = 200000;
+	int world_size = 128;
+};
+
+static void setupConfig(VoxelConfig& config, int world_size) {
+	config.dims_x = world_size;
+	config.dims_y = world_size;
+	config.dims_z = world_size;
+
+	config.atlasWidth = 4;
+	config.atlasHeight = 4;
+
+	// Types 1-8 are cubes, each with their own top, bottom and sides so textured meshes don't merge everything.
+	for (int i = 1; i <= 8; i++) {
+		VoxelType& type = config.voxelTypes[i];
+		type.form = VFORM_CUBE;
+		type.side_xPos = type.side_xNeg = type.side_yPos = type.side_yNeg = AtlasPos(i % 4, i / 4);
+		type.side_zPos = AtlasPos((i + 1) % 4, (i + 1) / 4);
+		type.side_zNeg = AtlasPos((i + 2) % 4, (i + 2) / 4);
+	}
+}
+
+static void fillWorld(VoxelWorld* world, const std::vector<XYZCoordinate>& positions, const BenchScenario& scenario) {
+	std::mt19937 rng(1337);
+
+	BlockData raw[VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
+
+	for (const XYZCoordinate& pos : positions) {
+		for (int z = 0; z < VOXEL_CHUNK_SIZE; z++) {
+			for (int y = 0; y < VOXEL_CHUNK_SIZE; y++) {
+				for (int x = 0; x < VOXEL_CHUNK_SIZE; x++) {
+					raw[x + y*VOXEL_CHUNK_SIZE + z*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE] =
+						scenario.generate(pos[0] * VOXEL_CHUNK_SIZE + x, pos[1] * VOXEL_CHUNK_SIZE + y, pos[2] * VOXEL_CHUNK_SIZE + z, rng);
+				}
+			}
+		}
+
+		world->getChunk(pos[0], pos[1], pos[2])->setAll(raw);
+	}
+}
+
+// Returns the total number of quads, so the two meshers can be checked against each other.
+static long long benchMeshing(VoxelWorld* world, const std::vector<XYZCoordinate>& positions, const VoxelConfig& config,
+	VoxelMesher mesher, bool textured, int iterations) {
+
+	VoxelMeshInput* input = new VoxelMeshInput();
+	VoxelChunkSnapshot snap;
+	std::vector<VoxelQuad> quads;
+
+	BenchMeshBuilder builder;
+	BenchPolysoup soup;
+
+	double mesh_time = 0;
+	double emit_time = 0;
+	long long total_quads = 0;
+	long long total_verts = 0;
+
+	// Meshes VoxelChunk::uploadMesh would split the quads into, one draw call each
+	long long total_draws = 0;
+	int biggest_chunk = 0;
+
+	for (int i = 0; i < iterations; i++) {
+		for (const XYZCoordinate& pos : positions) {
+			VoxelChunk* chunk = world->getChunk(pos[0], pos[1], pos[2]);
+
+			// Same work VoxelChunk::build does, minus the engine
+			auto start = BenchClock::now();
+
+			chunk->snapshotForMeshing(*input, snap);
+			unpackMeshInput(snap, *input);
+			input->textured = textured;
+
+			quads.clear();
+			buildChunkMesh(*input, quads, mesher);
+
+			mesh_time += secondsSince(start);
+
+			start = BenchClock::now();
+
+			builder.verts.clear();
+			soup.verts.clear();
+
+			for (const VoxelQuad& quad : quads) {
+				if (textured) {
+					emitQuadVertices(builder, quad);
+				}
+				else {
+					emitQuadTriangles([&soup](const Vector& v1, const Vector& v2, const Vector& v3) {
+						soup.addTriangle(v1, v2, v3);
+					}, quad, config, pos);
+				}
+			}
+
+			emit_time += secondsSince(start);
+
+			total_quads += quads.size();
+			total_verts += builder.verts.size() + soup.verts.size();
+
+			total_draws += (quads.size() + MESH_MAX_QUADS - 1) / MESH_MAX_QUADS;
+			biggest_chunk = std::max(biggest_chunk, (int)quads.size());
+		}
+	}
+
+	delete input;
+
+	double chunks = (double)positions.size() * iterations;
+
+	printf("  mesh %-6s %-8s %10.0f ns/chunk  emit %8.0f ns/chunk  %8.1f quads/chunk  %8.1f verts/chunk\n",
+		mesher == VMESHER_NAIVE ? "naive" : "binary", textured ? "render" : "physics",
+		mesh_time / chunks * 1e9, emit_time / chunks * 1e9, total_quads / chunks, total_verts / chunks);
+
+	if (textured) {
+		printf("  mesh %-6s draws    %10.2f /chunk        biggest chunk %6i quads\n",
+			mesher == VMESHER_NAIVE ? "naive" : "binary", total_draws / chunks, biggest_chunk);
+	}
+
+	if (biggest_chunk > MESH_WORST_CASE_QUADS)
+		printf("  !! MESH LIMIT MISMATCH: a chunk made %i quads, MESH_WORST_CASE_QUADS is %i\n", biggest_chunk, MESH_WORST_CASE_QUADS);
+
+	return total_quads;
+}
+
+// Decodes every compact vertex the way voxels_vs20.fxc does and compares it to the old float format.
+// Texture coordinates only have to match up to whole tiles, that's all the pixel shader looks at.
+static void checkVertexFormat(VoxelWorld* world, const std::vector<XYZCoordinate>& positions, const VoxelConfig& config) {
+	VoxelMeshInput* input = new VoxelMeshInput();
+	VoxelChunkSnapshot snap;
+	std::vector<VoxelQuad> quads;
+
+	BenchMeshBuilder compact;
+	BenchFloatMeshBuilder reference;
+
+	float tile_size[2] = { 1.0f / config.atlasWidth, 1.0f / config.atlasHeight };
+
+	long long total_verts = 0;
+	long long bad_verts = 0;
+
+	for (const XYZCoordinate& pos : positions) {
+		VoxelChunk* chunk = world->getChunk(pos[0], pos[1], pos[2]);
+
+		chunk->snapshotForMeshing(*input, snap);
+		unpackMeshInput(snap, *input);
+		input->textured = true;
+
+		quads.clear();
+		buildChunkMesh(*input, quads);
+
+		compact.verts.clear();
+		reference.verts.clear();
+
+		for (const VoxelQuad& quad : quads) {
+			emitQuadVertices(compact, quad);
+			emitQuadVerticesFloat(reference, quad, config, pos);
+		}
+
+		if (compact.verts.size() != reference.verts.size()) {
+			bad_verts += reference.verts.size();
+			continue;
+		}
+
+		// How far off the quad's uvs are from the float ones. The pixel shader wraps them, so any whole number of tiles is fine
+		// as long as it's the same for all 4 corners, otherwise the texture gets flipped or stretched across the quad.
+		float uv_offset[2];
+
+		for (size_t i = 0; i < compact.verts.size(); i++) {
+			const BenchMeshBuilder::Vertex& v = compact.verts[i];
+			const BenchFloatMeshBuilder::Vertex& ref = reference.verts[i];
+
+			float normal[3], uv[2], tile_base[2];
+			decodeCompactVertex(v.pos, v.color, tile_size, normal, uv, tile_base);
+
+			bool ok = true;
+
+			// What the per-chunk model matrix does
+			for (int axis = 0; axis < 3; axis++) {
+				float world_pos = (v.pos[axis] + pos[axis] * VOXEL_CHUNK_SIZE) * config.scale;
+				ok &= fabs(world_pos - ref.pos[axis]) <= 1e-3 * fabs(ref.pos[axis]) + 1e-3;
+				ok &= normal[axis] == ref.normal[axis];
+			}
+
+			for (int i_uv = 0; i_uv < 2; i_uv++) {
+				float tiles = ref.texcoord[0][i_uv] - uv[i_uv];
+				if (i % 4 == 0)
+					uv_offset[i_uv] = tiles;
+
+				ok &= tiles == floor(tiles) && tiles == uv_offset[i_uv];
+				ok &= fabs(tile_base[i_uv] - ref.texcoord[1][i_uv]) < 1e-6;
+			}
+
+			if (!ok)
+				bad_verts++;
+		}
+
+		total_verts += compact.verts.size();
+	}
+
+	delete input;
+
+	// The old format also had 4 floats of userdata nothing used
+	printf("  vertex format %i -> %i bytes/vert, %lli verts checked\n",
+		(int)(sizeof(BenchFloatMeshBuilder::Vertex) + sizeof(float) * 4), (int)sizeof(BenchMeshBuilder::Vertex), total_verts);
+
+	if (bad_verts != 0)
+		printf("  !! VERTEX FORMAT MISMATCH: %lli compact verts don't decode to the float ones\n", bad_verts);
+}
+
+static void benchTraces(VoxelWorld* world, const VoxelConfig& config, bool hull, int count) {
+	std::mt19937 rng(4242);
+	std::uniform_real_distribution<double> pos_x(0, config.dims_x);
+	std::uniform_real_distribution<double> pos_y(0, config.dims_y);
+	std::uniform_real_distribution<double> pos_z(0, config.dims_z);
+	std::uniform_real_distribution<double> unit(-1, 1);
+
+	// Roughly a player hull, in voxels
+	Vector extents(16 / config.scale, 16 / config.scale, 36 / config.scale);
+
+	std::vector<Vector> starts(count);
+	std::vector<Vector> deltas(count);
+
+	for (int i = 0; i < count; i++) {
+		// Prefer starting in air, otherwise nearly every trace on terrain ends before it starts
+		Vector start;
+		for (int tries = 0; tries < 16; tries++) {
+			start = Vector(pos_x(rng), pos_y(rng), pos_z(rng));
+			if (config.voxelTypes[world->get(start.x, start.y, start.z)].form != VFORM_CUBE)
+				break;
+		}
+
+		Vector dir(unit(rng), unit(rng), unit(rng));
+		dir.NormalizeInPlace();
+
+		starts[i] = start;
+		deltas[i] = dir * 64;
+	}
+
+	int hits = 0;
+
+	auto start = BenchClock::now();
+
+	for (int i = 0; i < count; i++) {
+		VoxelTraceRes res = hull ?
+			world->iTraceHull(starts[i], deltas[i], extents, Vector(0, 0, 0)) :
+			world->iTrace(starts[i], deltas[i], Vector(0, 0, 0));
+
+		if (res.fraction >= 0)
+			hits++;
+	}
+
+	double elapsed = secondsSince(start);
+
+	printf("  %-20s %12.0f traces/sec  %5.1f%% hit\n", hull ? "iTraceHull" : "iTrace", count / elapsed, 100.0 * hits / count);
+
+	// Same traces again through the batched lua entry point, which works in world units
+	std::vector<float> packed;
+	for (int i = 0; i < count; i++) {
+		Vector s = starts[i] * config.scale;
+		Vector d = deltas[i] * config.scale;
+		float trace[6] = { s.x, s.y, s.z, d.x, d.y, d.z };
+		packed.insert(packed.end(), trace, trace + 6);
+	}
+
+	std::vector<float> results(count * 7);
+
+	for (int parallel = 0; parallel <= 1; parallel++) {
+		auto batch_start = BenchClock::now();
+
+		world->doTraceMany((const unsigned char*)packed.data(), (unsigned char*)results.data(), count, hull, extents * config.scale, parallel != 0);
+
+		double batch_elapsed = secondsSince(batch_start);
+
+		int batch_hits = 0;
+		for (int i = 0; i < count; i++) {
+			if (results[i * 7] >= 0)
+				batch_hits++;
+		}
+
+		printf("  %-20s %12.0f traces/sec  %5.1f%% hit\n", parallel ? "doTraceMany (mt)" : "doTraceMany",
+			count / batch_elapsed, 100.0 * batch_hits / count);
+	}
+}
+
+// Compressed size and speed of every codec over the same chunks, and a check that they all decode back exactly.
+static void benchCodecs(VoxelWorld* world, const std::vector<XYZCoordinate>& positions, int iterations) {
+	const int voxels = VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE;
+
+	std::vector<BlockData> raw(positions.size() * voxels);
+	for (size_t i = 0; i < positions.size(); i++) {
+		const XYZCoordinate& pos = positions[i];
+		world->getChunk(pos[0], pos[1], pos[2])->getData().unpack(&raw[i * voxels]);
+	}
+
+	static char buffer[CODEC_MAX_COMPRESSED_SIZE];
+	std::vector<BlockData> decoded(voxels);
+
+	for (int codec = 0; codec < VCODEC_COUNT; codec++) {
+		long long total_compressed = 0;
+
+		auto start = BenchClock::now();
+
+		for (int i = 0; i < iterations; i++) {
+			for (size_t c = 0; c < positions.size(); c++) {
+				total_compressed += voxCompress((VoxelCodec)codec, &raw[c * voxels], buffer);
+			}
+		}
+
+		double compress_elapsed = secondsSince(start);
+
+		// Decoding, one compressed copy of each chunk at a time
+		double decompress_elapsed = 0;
+		bool mismatch = false;
+
+		for (size_t c = 0; c < positions.size(); c++) {
+			int size = voxCompress((VoxelCodec)codec, &raw[c * voxels], buffer);
+
+			auto decode_start = BenchClock::now();
+			for (int i = 0; i < iterations; i++) {
+				voxDecompress(buffer, size, decoded.data());
+			}
+			decompress_elapsed += secondsSince(decode_start);
+
+			if (memcmp(decoded.data(), &raw[c * voxels], voxels * sizeof(BlockData)) != 0)
+				mismatch = true;
+		}
+
+		double chunks = (double)positions.size() * iterations;
+		double raw_bytes = chunks * voxels * sizeof(BlockData);
+
+		printf("  codec %-14s %8.1f MB/s in %8.1f MB/s out %8.0f bytes/chunk (%.1f%%)\n", voxCodecName((VoxelCodec)codec),
+			raw_bytes / compress_elapsed / (1024 * 1024), raw_bytes / decompress_elapsed / (1024 * 1024),
+			total_compressed / chunks, 100.0 * total_compressed / raw_bytes);
+
+		if (mismatch)
+			printf("  !! CODEC MISMATCH: %s didn't decode back to the same voxels\n", voxCodecName((VoxelCodec)codec));
+	}
+}
+
+static void benchGenerators(const BenchSettings& settings) {
+	// Same chunks for every generator, the whole bench world
+	std::vector<XYZCoordinate> positions;
+	int chunks_across = settings.world_size / VOXEL_CHUNK_SIZE;
+	for (Coord x = 0; x < chunks_across; x++) {
+		for (Coord y = 0; y < chunks_across; y++) {
+			for (Coord z = 0; z < chunks_across; z++)
+				positions.push_back({ x, y, z });
+		}
+	}
+
+	BlockData raw[VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
+	BlockData reference[VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
+
+	printf("generators, %i chunks\n", (int)positions.size());
+
+	// What VoxelChunk::generate used to do, one call per voxel
+	bool mismatch = false;
+	double reference_time = 0;
+	for (int i = 0; i < settings.mesh_iterations; i++) {
+		for (const XYZCoordinate& pos : positions) {
+			auto start = BenchClock::now();
+
+			for (int z = 0; z < VOXEL_CHUNK_SIZE; z++) {
+				for (int y = 0; y < VOXEL_CHUNK_SIZE; y++) {
+					for (int x = 0; x < VOXEL_CHUNK_SIZE; x++) {
+						reference[x + y*VOXEL_CHUNK_SIZE + z*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE] =
+							vox_worldgen_basic(pos[0] * VOXEL_CHUNK_SIZE + x, pos[1] * VOXEL_CHUNK_SIZE + y, pos[2] * VOXEL_CHUNK_SIZE + z);
+					}
+				}
+			}
+
+			reference_time += secondsSince(start);
+
+			voxGenerateChunk(VGEN_BASIC, pos[0] * VOXEL_CHUNK_SIZE, pos[1] * VOXEL_CHUNK_SIZE, pos[2] * VOXEL_CHUNK_SIZE, raw);
+			if (memcmp(raw, reference, sizeof(raw)) != 0)
+				mismatch = true;
+		}
+	}
+
+	double chunks = (double)positions.size() * settings.mesh_iterations;
+
+	printf("  gen %-8s %10.0f ns/chunk\n", "voxel", reference_time / chunks * 1e9);
+
+	for (int generator = 0; generator < VGEN_COUNT; generator++) {
+		auto start = BenchClock::now();
+
+		for (int i = 0; i < settings.mesh_iterations; i++) {
+			for (const XYZCoordinate& pos : positions)
+				voxGenerateChunk((VoxelGenerator)generator, pos[0] * VOXEL_CHUNK_SIZE, pos[1] * VOXEL_CHUNK_SIZE, pos[2] * VOXEL_CHUNK_SIZE, raw);
+		}
+
+		double elapsed = secondsSince(start);
+
+		printf("  gen %-8s %10.0f ns/chunk  %6.1fx voxel\n", voxGeneratorName((VoxelGenerator)generator),
+			elapsed / chunks * 1e9, reference_time / elapsed);
+	}
+
+	if (mismatch)
+		printf("  !! GENERATOR MISMATCH: basic didn't make the same chunks as vox_worldgen_basic\n");
+
+	printf("\n");
+}
+
+// Differing voxels between two copies of a chunk, all of them if the client doesn't have it
+static int diffChunk(VoxelWorld* server, VoxelWorld* client, const XYZCoordinate& pos) {
+	const int voxels = VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE;
+
+	VoxelChunk* theirs = client->getChunk(pos[0], pos[1], pos[2]);
+	if (theirs == nullptr)
+		return voxels;
+
+	BlockData expected[VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
+	BlockData got[VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
+	server->getChunk(pos[0], pos[1], pos[2])->getData().unpack(expected);
+	theirs->getData().unpack(got);
+
+	int differing = 0;
+	for (int i = 0; i < voxels; i++)
+		differing += expected[i] != got[i];
+
+	return differing;
+}
+
+// Streams a server world to a client world over the loopback network, with the peer walking back and forth so chunks keep
+// getting unloaded and resent, and edits landing on them right after every resend. Each tick everything gets delivered with
+// the channels shuffled together, then every chunk in view has to match the server.
+static void checkStreaming() {
+	const int world_size = 256;
+	const int view_radius = 3;
+	const int ticks = 200;
+	const int edits_per_tick = 400;
+	const int peer = 0;
+
+	VoxelConfig config;
+	setupConfig(config, world_size);
+	config.viewRadius = view_radius;
+	config.viewHysteresis = 0;
+
+	// The client world is the one the packets find by ID. The server one stays out of the registry.
+	voxelworld_initialise_networking_static();
+
+	int client_id = newIndexedVoxelWorld(-1, config);
+	VoxelWorld* client = getIndexedVoxelWorld(client_id);
+
+	VoxelWorld* server = new VoxelWorld(config);
+	server->worldID = client_id;
+
+	fillWorld(server, server->getAllChunkPositions(Vector(0, 0, 0)), scenarios[1]);
+
+	std::mt19937 rng(1337);
+
+	double chunk_width = VOXEL_CHUNK_SIZE * config.scale;
+	Coord middle = world_size / VOXEL_CHUNK_SIZE / 2;
+
+	// Edits go anywhere in view, and a bit past it
+	std::uniform_int_distribution<Coord> offset(-view_radius * VOXEL_CHUNK_SIZE, (view_radius + 1) * VOXEL_CHUNK_SIZE - 1);
+
+	long long packets = 0;
+	long long stale_voxels = 0;
+	int stale_ticks = 0;
+
+	server->streamStart(peer, Vector(middle * chunk_width, middle * chunk_width, middle * chunk_width));
+
+	for (int tick = 0; tick < ticks; tick++) {
+		// Two chunks either side of the middle, a couple of ticks each
+		Coord center_x = middle + ((tick / 2) % 2 ? 2 : -2);
+		Vector origin((center_x + 0.5) * chunk_width, (middle + 0.5) * chunk_width, (middle + 0.5) * chunk_width);
+
+		server->streamUpdate(peer, origin, 1 << 24);
+
+		// Made after the chunks went out, so these only get to the client in edit packets
+		for (int i = 0; i < edits_per_tick; i++) {
+			server->set(center_x * VOXEL_CHUNK_SIZE + offset(rng), middle * VOXEL_CHUNK_SIZE + offset(rng), middle * VOXEL_CHUNK_SIZE + offset(rng),
+				rng() % 9);
+		}
+
+		if (server->flushEdits())
+			server->sendEdits(peer);
+
+		packets += benchNetDeliver(rng);
+
+		int stale = 0;
+		for (Coord z = middle - view_radius; z <= middle + view_radius; z++) {
+			for (Coord y = middle - view_radius; y <= middle + view_radius; y++) {
+				for (Coord x = center_x - view_radius; x <= center_x + view_radius; x++) {
+					Coord dx = x - center_x;
+					Coord dy = y - middle;
+					Coord dz = z - middle;
+					if (dx*dx + dy*dy + dz*dz > view_radius*view_radius)
+						continue;
+
+					stale += diffChunk(server, client, { x, y, z });
+				}
+			}
+		}
+
+		stale_voxels += stale;
+		if (stale > 0)
+			stale_ticks++;
+	}
+
+	printf("streaming, %i ticks, %i edits a tick, %lli packets\n", ticks, edits_per_tick, packets);
+
+	if (stale_voxels > 0)
+		printf("  !! STREAM MISMATCH: %lli voxels on the client didn't match the server, over %i ticks\n", stale_voxels, stale_ticks);
+
+	printf("\n");
+
+	server->streamStop(peer);
+	delete server;
+	deleteIndexedVoxelWorld(client_id);
+}
+
+static void runScenario(const BenchScenario& scenario, const BenchSettings& settings) {
+	VoxelConfig config;
+	setupConfig(config, settings.world_size);
+
+	// Generates the whole world on construction, we overwrite it right after
+	auto start = BenchClock::now();
+	VoxelWorld* world = new VoxelWorld(config);
+	double generate_time = secondsSince(start);
+
+	std::vector<XYZCoordinate> positions = world->getAllChunkPositions(Vector(0, 0, 0));
+
+	fillWorld(world, positions, scenario);
+
+	printf("%s (%s), %i chunks\n", scenario.name, scenario.description, (int)positions.size());
+	printf("  generate %10.0f ns/chunk  %8.2f ms total\n", generate_time / positions.size() * 1e9, generate_time * 1e3);
+
+	for (int textured = 1; textured >= 0; textured--) {
+		long long naive_quads = benchMeshing(world, positions, config, VMESHER_NAIVE, textured != 0, settings.mesh_iterations);
+		long long binary_quads = benchMeshing(world, positions, config, VMESHER_BINARY, textured != 0, settings.mesh_iterations);
+
+		if (naive_quads != binary_quads)
+			printf("  !! MESHER MISMATCH: naive made %lli quads, binary made %lli\n", naive_quads, binary_quads);
+	}
+
+	checkVertexFormat(world, positions, config);
+
+	benchTraces(world, config, false, settings.traces);
+	benchTraces(world, config, true, settings.traces);
+
+	benchCodecs(world, positions, settings.mesh_iterations);
+
+	printf("\n");
+
+	delete world;
+}
+
+int main(int argc, char** argv) {
+	BenchSettings settings;
+	std::vector<std::string> filter;
+
+	for (int i = 1; i < argc; i++) {
+		if (i + 1 < argc && strcmp(argv[i], "-i") == 0)
+			settings.mesh_iterations = atoi(argv[++i]);
+		else if (i + 1 < argc && strcmp(argv[i], "-t") == 0)
+			settings.traces = atoi(argv[++i]);
+		else if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+			settings.world_size = atoi(argv[++i]);
+		else
+			filter.push_back(argv[i]);
+	}
+
+	if (settings.mesh_iterations < 1 || settings.traces < 1 || settings.world_size < VOXEL_CHUNK_SIZE) {
+		printf("Usage: %s [-i mesh_iterations] [-t traces] [-s world_size] [scenario ...]\n", argv[0]);
+		return 1;
+	}
+
+	printf("voxelate_bench: %i^3 voxel world, %i mesh iterations, %i traces\n\n", settings.world_size, settings.mesh_iterations, settings.traces);
+
+	if (filter.empty()) {
+		benchGenerators(settings);
+		checkStreaming();
+	}
+
+	for (const BenchScenario& scenario : scenarios) {
+		if (!filter.empty()) {
+			bool wanted = false;
+			for (const std::string& name : filter) {
+				if (name == scenario.name)
+					wanted = true;
+			}
+
+			if (!wanted)
+				continue;
+		}
+
+		runScenario(scenario, settings);
+	}
+
+	return 0;
+}
@@ -0,0 +1,62 @@
+#include <deque>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "vox_network.h"
+
+#include "vox_bench_net.h"
+
+static std::unordered_map<int, networkCallback> listeners;
+static std::map<uint16_t, std::deque<std::string>> queued;
+
+namespace networking {
+	void channelListen(uint16_t channelID, networkCallback callback) {
+		listeners[channelID] = callback;
+	}
+
+	bool channelSend(int peerID, uint16_t channelID, void* data, int size, bool unreliable) {
+		queued[channelID].emplace_back((const char*)data, size);
+		return true;
+	}
+
+	ENetPacket* channelCreatePacket(size_t size, bool unreliable) {
+		return enet_packet_create(nullptr, size, unreliable ? 0 : ENET_PACKET_FLAG_RELIABLE);
+	}
+
+	bool channelSendPacket(int peerID, uint16_t channelID, ENetPacket* packet) {
+		channelSend(peerID, channelID, packet->data, packet->dataLength);
+		enet_packet_destroy(packet);
+		return true;
+	}
+}
+
+int benchNetDeliver(std::mt19937& rng) {
+	int delivered = 0;
+
+	std::vector<uint16_t> channels;
+	for (;;) {
+		channels.clear();
+		for (auto& entry : queued) {
+			if (!entry.second.empty())
+				channels.push_back(entry.first);
+		}
+
+		if (channels.empty())
+			return delivered;
+
+		uint16_t channelID = channels[rng() % channels.size()];
+
+		std::deque<std::string>& queue = queued[channelID];
+		std::string packet = std::move(queue.front());
+		queue.pop_front();
+
+		// The client only ever hears from the server, which it calls peer 0
+		auto it = listeners.find(channelID);
+		if (it != listeners.end())
+			it->second(0, packet.data(), packet.size());
+
+		delivered++;
+	}
+}
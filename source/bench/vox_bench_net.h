@@ -0,0 +1,11 @@
+#pragma once
+
+#include <random>
+
+// Loopback stand-in for vox_network.cpp, so the benchmark can run a server and a client world in the same process.
+// Sent packets wait in a queue per channel until benchNetDeliver hands them to whoever is listening.
+
+// Delivers everything that's queued. ENet only keeps packets in order within a channel, so every packet comes
+// off a random channel, which is as far out of order as a real connection is allowed to get.
+// Returns how many packets were delivered.
+int benchNetDeliver(std::mt19937& rng);
@@ -0,0 +1,27 @@
+#include <cstdio>
+#include <cstdarg>
+
+#include "vox_engine.h"
+#include "vox_util.h"
+
+// Everything vox_voxelworld.cpp wants from the engine, so the benchmark links without it.
+// None of these get touched as long as the benchmark never uploads, draws or builds physics objects.
+
+IVEngineServer* IFACE_SV_ENGINE = nullptr;
+IPhysics* IFACE_SV_PHYSICS = nullptr;
+IPhysicsCollision* IFACE_SV_COLLISION = nullptr;
+
+IMaterialSystem* IFACE_CL_MATERIALS = nullptr;
+
+void vox_print(const char* msg, ...) {
+	va_list args;
+	va_start(args, msg);
+	vprintf(msg, args);
+	va_end(args);
+
+	printf("\n");
+}
+
+Vector eent_getPos(CBaseEntity* ent) {
+	return Vector(0, 0, 0);
+}
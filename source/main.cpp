@@ -8,6 +8,7 @@
 #include "vox_voxelworld.h"
 #include "vox_network.h"
 #include "vox_shaders.h"
+#include "vox_threadpool.h"
 
 #include "sn_bf_read.hpp"
 #include "sn_bf_write.hpp"
@@ -54,6 +55,8 @@ GMOD_MODULE_CLOSE() {
 
 	checkAllVoxelWorldsDeleted();
 
+	shutdownThreadPool();
+
 	uninstallShaders();
 
 	network_shutdown();
@@ -25,7 +25,8 @@ SHADER_DRAW
 	SHADOW_STATE
 	{
 
-		pShaderShadow->VertexShaderVertexFormat(VERTEX_POSITION | VERTEX_NORMAL, 2, 0, 0);
+		// Compact vertices, see emitQuadVertices in vox_mesher.h
+		pShaderShadow->VertexShaderVertexFormat(VERTEX_POSITION | VERTEX_COLOR, 0, 0, 0);
 		
 		pShaderShadow->EnableTexture(SHADER_SAMPLER0, true);
 		pShaderShadow->EnableSRGBRead(SHADER_SAMPLER0, true);
@@ -51,6 +52,14 @@ SHADER_DRAW
 		v[1] = 0.5f / MAX(params[ATLAS_H]->GetIntValue(), 1);
 
 		pShaderAPI->SetPixelShaderConstant(0, v, 1);
+
+		// The vertex shader turns tile coordinates into texture space
+		float tile[4] = { 0, 0, 0, 0 };
+
+		tile[0] = 1.0f / MAX(params[ATLAS_W]->GetIntValue(), 1);
+		tile[1] = 1.0f / MAX(params[ATLAS_H]->GetIntValue(), 1);
+
+		pShaderAPI->SetVertexShaderConstant(VERTEX_SHADER_SHADER_SPECIFIC_CONST_0, tile, 1);
 		
 		DECLARE_DYNAMIC_VERTEX_SHADER(voxels_vs20);
 		SET_DYNAMIC_VERTEX_SHADER(voxels_vs20);
@@ -0,0 +1,203 @@
+#include "vox_blockstorage.h"
+
+#include <utility>
+
+// Palette entries that fit in a given index width. Anything past 8 bits is stored raw.
+static int paletteCapacity(int bits) {
+	return 1 << bits;
+}
+
+PalettedBlockStorage::PalettedBlockStorage() {
+	fill(0);
+}
+
+void PalettedBlockStorage::set(int index, BlockData d) {
+	if (bits == 16) {
+		writeIndex(index, d);
+		return;
+	}
+
+	if (palette[bits == 0 ? 0 : readIndex(index)] == d)
+		return;
+
+	int entry = findOrAddPaletteEntry(d);
+
+	if (entry < 0) {
+		// Just went raw, palette is gone
+		writeIndex(index, d);
+		return;
+	}
+
+	// Widening re-packs everything and can shuffle the palette, so look the old value up again
+	std::uint32_t old_entry = readIndex(index);
+
+	writeIndex(index, entry);
+	palette_counts[entry]++;
+
+	if (--palette_counts[old_entry] == 0) {
+		palette_used--;
+
+		// Go down a width once we'd only fill half of it, so a chunk sitting right on the edge
+		// doesn't re-pack on every single set.
+		if (palette_used == 1 || palette_used * 2 <= paletteCapacity(bits / 2)) {
+			BlockData values[BLOCKSTORAGE_VOXELS];
+			unpack(values);
+			encode(values, palette_used == 1 ? 0 : palette_used * 2);
+		}
+	}
+}
+
+void PalettedBlockStorage::fill(BlockData d) {
+	bits = 0;
+	mask = 0;
+
+	palette.assign(1, d);
+	palette_counts.assign(1, BLOCKSTORAGE_VOXELS);
+	palette_used = 1;
+
+	words.clear();
+	words.shrink_to_fit();
+}
+
+void PalettedBlockStorage::pack(const BlockData* values) {
+	encode(values, 0);
+}
+
+void PalettedBlockStorage::unpack(BlockData* out) const {
+	if (bits == 0) {
+		for (int i = 0; i < BLOCKSTORAGE_VOXELS; i++)
+			out[i] = palette[0];
+	}
+	else if (bits == 16) {
+		for (int i = 0; i < BLOCKSTORAGE_VOXELS; i++)
+			out[i] = readIndex(i);
+	}
+	else {
+		for (int i = 0; i < BLOCKSTORAGE_VOXELS; i++)
+			out[i] = palette[readIndex(i)];
+	}
+}
+
+std::size_t PalettedBlockStorage::getMemoryUsage() const {
+	return sizeof(*this) +
+		palette.capacity() * sizeof(BlockData) +
+		palette_counts.capacity() * sizeof(std::uint16_t) +
+		words.capacity() * sizeof(std::uint32_t);
+}
+
+int PalettedBlockStorage::findOrAddPaletteEntry(BlockData d) {
+	int free_entry = -1;
+
+	for (int i = 0; i < (int)palette.size(); i++) {
+		if (palette_counts[i] == 0) {
+			if (free_entry == -1)
+				free_entry = i;
+		}
+		else if (palette[i] == d) {
+			return i;
+		}
+	}
+
+	if (free_entry != -1) {
+		palette[free_entry] = d;
+		palette_used++;
+		return free_entry;
+	}
+
+	if ((int)palette.size() < paletteCapacity(bits)) {
+		palette.push_back(d);
+		palette_counts.push_back(0);
+		palette_used++;
+		return palette.size() - 1;
+	}
+
+	// Out of room, widen. This also drops any free entries.
+	BlockData values[BLOCKSTORAGE_VOXELS];
+	unpack(values);
+	encode(values, palette_used + 1);
+
+	if (bits == 16)
+		return -1;
+
+	palette.push_back(d);
+	palette_counts.push_back(0);
+	palette_used++;
+	return palette.size() - 1;
+}
+
+void PalettedBlockStorage::encode(const BlockData* values, int min_entries) {
+	std::vector<BlockData> new_palette;
+	std::vector<std::uint16_t> new_counts;
+
+	std::uint16_t indices[BLOCKSTORAGE_VOXELS];
+
+	// Terrain is mostly long runs of the same thing, so remembering the last hit saves most of the searching.
+	int last_entry = -1;
+	bool raw = false;
+
+	for (int i = 0; i < BLOCKSTORAGE_VOXELS; i++) {
+		BlockData v = values[i];
+
+		if (last_entry == -1 || new_palette[last_entry] != v) {
+			last_entry = -1;
+			for (int j = 0; j < (int)new_palette.size(); j++) {
+				if (new_palette[j] == v) {
+					last_entry = j;
+					break;
+				}
+			}
+
+			if (last_entry == -1) {
+				if (new_palette.size() == 256) {
+					raw = true;
+					break;
+				}
+
+				new_palette.push_back(v);
+				new_counts.push_back(0);
+				last_entry = new_palette.size() - 1;
+			}
+		}
+
+		new_counts[last_entry]++;
+		indices[i] = last_entry;
+	}
+
+	if (raw || min_entries > 256) {
+		bits = 16;
+		mask = 0xFFFF;
+
+		palette.clear();
+		palette.shrink_to_fit();
+		palette_counts.clear();
+		palette_counts.shrink_to_fit();
+		palette_used = 0;
+
+		words.assign(BLOCKSTORAGE_VOXELS * 16 / 32, 0);
+		for (int i = 0; i < BLOCKSTORAGE_VOXELS; i++)
+			writeIndex(i, values[i]);
+		return;
+	}
+
+	int needed = (int)new_palette.size() > min_entries ? new_palette.size() : min_entries;
+
+	if (needed <= 1) {
+		fill(new_palette[0]);
+		return;
+	}
+
+	int new_bits = 1;
+	while (paletteCapacity(new_bits) < needed)
+		new_bits *= 2;
+
+	bits = new_bits;
+	mask = (1u << bits) - 1;
+
+	palette_used = new_palette.size();
+	palette = std::move(new_palette);
+	palette_counts = std::move(new_counts);
+
+	words.assign(BLOCKSTORAGE_VOXELS * bits / 32, 0);
+	for (int i = 0; i < BLOCKSTORAGE_VOXELS; i++)
+		writeIndex(i, indices[i]);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Same as in vox_voxelworld.h, we can't include that from here.
+typedef std::uint16_t BlockData;
+
+#define BLOCKSTORAGE_VOXELS (16*16*16)
+
+// Palette compressed voxel storage for a single chunk.
+// Voxels are stored as indices into a small per-chunk palette, packed into as few bits as we can get away with:
+//  0 bits: the whole chunk is one value (air, solid stone...), we only store the palette
+//  1/2/4/8 bits: up to 2/4/16/256 distinct values
+//  16 bits: raw BlockData, no palette. Only used when a chunk has more than 256 distinct values.
+// Widens automatically when the palette fills up, and re-packs narrower once enough palette entries go unused.
+// Raw chunks only get a palette again through pack().
+class PalettedBlockStorage {
+public:
+	PalettedBlockStorage();
+
+	BlockData get(int index) const {
+		if (bits == 0)
+			return palette[0];
+
+		int bit = index * bits;
+		std::uint32_t v = (words[bit >> 5] >> (bit & 31)) & mask;
+
+		if (bits == 16)
+			return v;
+		return palette[v];
+	}
+
+	void set(int index, BlockData d);
+
+	// Sets every voxel to the same value.
+	void fill(BlockData d);
+
+	// Copies BLOCKSTORAGE_VOXELS values in and out of a flat array.
+	void pack(const BlockData* values);
+	void unpack(BlockData* out) const;
+
+	// True if pred(value) is true for any voxel. Each distinct value is only checked once, unless we're raw.
+	template<typename Pred>
+	bool anyOf(Pred pred) const {
+		if (bits == 16) {
+			for (int i = 0; i < BLOCKSTORAGE_VOXELS; i++) {
+				if (pred((BlockData)readIndex(i)))
+					return true;
+			}
+			return false;
+		}
+
+		for (int i = 0; i < (int)palette.size(); i++) {
+			if (palette_counts[i] != 0 && pred(palette[i]))
+				return true;
+		}
+		return false;
+	}
+
+	int getBitsPerIndex() const { return bits; }
+	int getPaletteSize() const { return palette_used; }
+	std::size_t getMemoryUsage() const;
+private:
+	std::uint32_t readIndex(int index) const {
+		int bit = index * bits;
+		return (words[bit >> 5] >> (bit & 31)) & mask;
+	}
+
+	void writeIndex(int index, std::uint32_t v) {
+		int bit = index * bits;
+		std::uint32_t& word = words[bit >> 5];
+		word = (word & ~(mask << (bit & 31))) | (v << (bit & 31));
+	}
+
+	// Returns the palette index for d, adding it if needed. Returns -1 if we had to switch to raw storage.
+	int findOrAddPaletteEntry(BlockData d);
+
+	// Rebuilds everything from a flat array, leaving room for at least min_entries palette entries.
+	void encode(const BlockData* values, int min_entries);
+
+	int bits;
+	std::uint32_t mask;
+
+	std::vector<BlockData> palette;
+	// How many voxels use each palette entry. Entries with a count of 0 are free to be reused.
+	std::vector<std::uint16_t> palette_counts;
+	int palette_used;
+
+	std::vector<std::uint32_t> words;
+};
+
+// Chunk voxels are shared between the chunk and whatever took a snapshot of it, and shared data never changes.
+// A chunk that gets written to while anything else still holds its data copies it first, see VoxelChunk::writeData.
+typedef std::shared_ptr<const PalettedBlockStorage> ChunkDataRef;
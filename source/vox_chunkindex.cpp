@@ -0,0 +1,175 @@
+#include "vox_chunkindex.h"
+
+#include <algorithm>
+#include <atomic>
+
+// Starting size of the sparse table, grows by doubling. Must be a power of two.
+#define CHUNKINDEX_SPARSE_MIN_SLOTS 64
+
+static std::atomic<std::uint64_t> next_stamp(1);
+
+thread_local VoxelChunkIndex::LastHit VoxelChunkIndex::last_hit = { 0, CHUNKKEY_NONE, nullptr };
+
+VoxelChunkIndex::VoxelChunkIndex() {
+	restamp();
+}
+
+void VoxelChunkIndex::restamp() {
+	stamp = next_stamp++;
+}
+
+void VoxelChunkIndex::setDenseBounds(int size_x, int size_y, int size_z) {
+	dense_x = size_x > 0 ? size_x : 0;
+	dense_y = size_y > 0 ? size_y : 0;
+	dense_z = size_z > 0 ? size_z : 0;
+
+	dense.assign(dense_x * dense_y * dense_z, nullptr);
+	dense_order.assign(dense.size(), 0);
+}
+
+void VoxelChunkIndex::insert(std::int32_t x, std::int32_t y, std::int32_t z, VoxelChunk* chunk) {
+	ChunkKey key = packChunkKey(x, y, z);
+	std::uint32_t order = all_chunks.size();
+
+	all_chunks.push_back(chunk);
+	all_keys.push_back(key);
+
+	if ((std::uint32_t)x < (std::uint32_t)dense_x && (std::uint32_t)y < (std::uint32_t)dense_y && (std::uint32_t)z < (std::uint32_t)dense_z) {
+		int index = x + y*dense_x + z*dense_x*dense_y;
+		dense[index] = chunk;
+		dense_order[index] = order;
+		return;
+	}
+
+	// Keep the table at most half full, probe chains stay short
+	if ((sparse_count + 1) * 2 > sparse.size())
+		growSparse();
+
+	std::size_t mask = sparse.size() - 1;
+	std::size_t i = slotFor(key);
+	while (sparse[i].key != CHUNKKEY_NONE)
+		i = (i + 1) & mask;
+
+	sparse[i].key = key;
+	sparse[i].chunk = chunk;
+	sparse[i].order = order;
+	sparse_count++;
+}
+
+VoxelChunk* VoxelChunkIndex::erase(std::int32_t x, std::int32_t y, std::int32_t z) {
+	ChunkKey key = packChunkKey(x, y, z);
+
+	VoxelChunk* chunk = nullptr;
+	std::uint32_t order = 0;
+
+	if ((std::uint32_t)x < (std::uint32_t)dense_x && (std::uint32_t)y < (std::uint32_t)dense_y && (std::uint32_t)z < (std::uint32_t)dense_z) {
+		int index = x + y*dense_x + z*dense_x*dense_y;
+		chunk = dense[index];
+		order = dense_order[index];
+		dense[index] = nullptr;
+	}
+	else if (sparse_count != 0) {
+		std::size_t mask = sparse.size() - 1;
+		std::size_t i = slotFor(key);
+
+		while (sparse[i].key != key) {
+			if (sparse[i].key == CHUNKKEY_NONE)
+				return nullptr;
+			i = (i + 1) & mask;
+		}
+
+		chunk = sparse[i].chunk;
+		order = sparse[i].order;
+		sparse_count--;
+
+		// Backward shift deletion: pull later entries of the probe chain into the hole,
+		// so lookups never have to step over tombstones.
+		std::size_t hole = i;
+		for (std::size_t j = (i + 1) & mask; sparse[j].key != CHUNKKEY_NONE; j = (j + 1) & mask) {
+			std::size_t home = slotFor(sparse[j].key);
+
+			// Only move j if its home slot isn't between the hole and j (cyclically)
+			bool movable = hole <= j ? (home <= hole || home > j) : (home <= hole && home > j);
+			if (movable) {
+				sparse[hole] = sparse[j];
+				hole = j;
+			}
+		}
+
+		sparse[hole].key = CHUNKKEY_NONE;
+		sparse[hole].chunk = nullptr;
+	}
+
+	if (chunk != nullptr) {
+		// Fill the gap with the last chunk
+		std::uint32_t last = all_chunks.size() - 1;
+
+		if (order != last) {
+			all_chunks[order] = all_chunks[last];
+			all_keys[order] = all_keys[last];
+			orderOf(all_keys[order]) = order;
+		}
+
+		all_chunks.pop_back();
+		all_keys.pop_back();
+
+		restamp();
+	}
+
+	return chunk;
+}
+
+// The chunk must be in the index
+std::uint32_t& VoxelChunkIndex::orderOf(ChunkKey key) {
+	std::int32_t x, y, z;
+	unpackChunkKey(key, x, y, z);
+
+	if ((std::uint32_t)x < (std::uint32_t)dense_x && (std::uint32_t)y < (std::uint32_t)dense_y && (std::uint32_t)z < (std::uint32_t)dense_z)
+		return dense_order[x + y*dense_x + z*dense_x*dense_y];
+
+	std::size_t mask = sparse.size() - 1;
+	std::size_t i = slotFor(key);
+	while (sparse[i].key != key)
+		i = (i + 1) & mask;
+
+	return sparse[i].order;
+}
+
+void VoxelChunkIndex::clear() {
+	std::fill(dense.begin(), dense.end(), nullptr);
+
+	sparse.clear();
+	sparse_count = 0;
+	sparse_shift = 64;
+
+	all_chunks.clear();
+	all_keys.clear();
+
+	restamp();
+}
+
+void VoxelChunkIndex::growSparse() {
+	std::vector<Slot> old_slots;
+	old_slots.swap(sparse);
+
+	std::size_t new_size = old_slots.size() < CHUNKINDEX_SPARSE_MIN_SLOTS ? CHUNKINDEX_SPARSE_MIN_SLOTS : old_slots.size() * 2;
+
+	sparse_shift = 64;
+	for (std::size_t n = new_size; n > 1; n >>= 1)
+		sparse_shift--;
+
+	Slot empty = { CHUNKKEY_NONE, nullptr, 0 };
+	sparse.assign(new_size, empty);
+
+	std::size_t mask = new_size - 1;
+	for (const Slot& slot : old_slots) {
+		if (slot.key == CHUNKKEY_NONE)
+			continue;
+
+		std::size_t i = slotFor(slot.key);
+		while (sparse[i].key != CHUNKKEY_NONE)
+			i = (i + 1) & mask;
+
+		sparse[i] = slot;
+	}
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+class VoxelChunk;
+
+// Chunk coordinates packed into a single key, 21 bits per axis. Coordinates wrap past +-1M chunks,
+// which is about 16M voxels, way more than we could ever keep loaded.
+// The top bit is never set, so ~0 works as an "empty" marker.
+typedef std::uint64_t ChunkKey;
+
+#define CHUNKKEY_NONE (~(ChunkKey)0)
+
+inline ChunkKey packChunkKey(std::int32_t x, std::int32_t y, std::int32_t z) {
+	return
+		((ChunkKey)(x & 0x1FFFFF)) |
+		((ChunkKey)(y & 0x1FFFFF) << 21) |
+		((ChunkKey)(z & 0x1FFFFF) << 42);
+}
+
+// Back to coordinates, sign extending each 21 bit field
+inline void unpackChunkKey(ChunkKey key, std::int32_t& x, std::int32_t& y, std::int32_t& z) {
+	x = (std::int32_t)((std::int64_t)(key << 43) >> 43);
+	y = (std::int32_t)((std::int64_t)(key << 22) >> 43);
+	z = (std::int32_t)((std::int64_t)(key << 1) >> 43);
+}
+
+// Chunk lookup for VoxelWorld. Every voxel get/set goes through here, so it needs to be fast:
+//  - Bounded worlds get a dense array of chunk pointers covering their dims, which is just some multiplies.
+//  - Anything outside of that goes in an open addressing table with linear probing, keyed on the packed coordinate.
+//  - The last chunk found is remembered, since lookups almost always hit the same chunk as the one before.
+//    That cache is per thread, so find() is safe to call from several threads at once, as long as nothing is inserting or erasing.
+class VoxelChunkIndex {
+public:
+	VoxelChunkIndex();
+
+	// Size of the dense array, in chunks. Call before inserting anything.
+	void setDenseBounds(int size_x, int size_y, int size_z);
+
+	VoxelChunk* find(std::int32_t x, std::int32_t y, std::int32_t z) const {
+		ChunkKey key = packChunkKey(x, y, z);
+
+		LastHit& last = last_hit;
+		if (last.key == key && last.stamp == stamp)
+			return last.chunk;
+
+		VoxelChunk* chunk;
+
+		if ((std::uint32_t)x < (std::uint32_t)dense_x && (std::uint32_t)y < (std::uint32_t)dense_y && (std::uint32_t)z < (std::uint32_t)dense_z)
+			chunk = dense[x + y*dense_x + z*dense_x*dense_y];
+		else
+			chunk = findSparse(key);
+
+		if (chunk != nullptr) {
+			last.key = key;
+			last.chunk = chunk;
+			last.stamp = stamp;
+		}
+
+		return chunk;
+	}
+
+	// Chunk must not already be in the index.
+	void insert(std::int32_t x, std::int32_t y, std::int32_t z, VoxelChunk* chunk);
+
+	// Returns the removed chunk, or nullptr if there wasn't one. Doesn't delete it.
+	VoxelChunk* erase(std::int32_t x, std::int32_t y, std::int32_t z);
+
+	void clear();
+
+	std::size_t size() const { return all_chunks.size(); }
+
+	// Iterates every chunk, in no particular order.
+	std::vector<VoxelChunk*>::const_iterator begin() const { return all_chunks.begin(); }
+	std::vector<VoxelChunk*>::const_iterator end() const { return all_chunks.end(); }
+private:
+	struct Slot {
+		ChunkKey key;
+		VoxelChunk* chunk;
+
+		// Where the chunk is in all_chunks
+		std::uint32_t order;
+	};
+
+	std::size_t slotFor(ChunkKey key) const {
+		// Fibonacci hashing, spreads the packed axes over the whole table
+		return (key * 0x9E3779B97F4A7C15ull) >> sparse_shift;
+	}
+
+	VoxelChunk* findSparse(ChunkKey key) const {
+		if (sparse_count == 0)
+			return nullptr;
+
+		std::size_t mask = sparse.size() - 1;
+		for (std::size_t i = slotFor(key);; i = (i + 1) & mask) {
+			const Slot& slot = sparse[i];
+			if (slot.key == key)
+				return slot.chunk;
+			if (slot.key == CHUNKKEY_NONE)
+				return nullptr;
+		}
+	}
+
+	void growSparse();
+
+	int dense_x = 0;
+	int dense_y = 0;
+	int dense_z = 0;
+	std::vector<VoxelChunk*> dense;
+
+	// Same as Slot::order, for the dense array
+	std::vector<std::uint32_t> dense_order;
+
+	std::vector<Slot> sparse;
+	std::size_t sparse_count = 0;
+	int sparse_shift = 64;
+
+	// Keys line up with chunks. Erasing moves the last chunk into the gap, its key says where to fix up its order.
+	std::vector<VoxelChunk*> all_chunks;
+	std::vector<ChunkKey> all_keys;
+
+	std::uint32_t& orderOf(ChunkKey key);
+
+	// Identifies this index and its current contents. Taken from a global counter, and replaced whenever a chunk is removed,
+	// so a cached hit can't outlive its chunk or get confused with another index that reused our address.
+	std::uint64_t stamp;
+
+	void restamp();
+
+	struct LastHit {
+		std::uint64_t stamp;
+		ChunkKey key;
+		VoxelChunk* chunk;
+	};
+
+	static thread_local LastHit last_hit;
+};
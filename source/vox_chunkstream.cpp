@@ -0,0 +1,51 @@
+#include "vox_chunkstream.h"
+
+void VoxelChunkStream::reset(const std::vector<XYZCoordinate>& positions, XYZCoordinate new_origin) {
+	origin = new_origin;
+
+	heap.clear();
+	heap.reserve(positions.size());
+
+	for (const XYZCoordinate& pos : positions) {
+		heap.push_back({ distanceTo(pos), pos });
+	}
+
+	std::make_heap(heap.begin(), heap.end());
+}
+
+void VoxelChunkStream::setOrigin(XYZCoordinate new_origin) {
+	if (new_origin == origin)
+		return;
+
+	origin = new_origin;
+
+	for (Entry& entry : heap) {
+		entry.dist = distanceTo(entry.pos);
+	}
+
+	std::make_heap(heap.begin(), heap.end());
+}
+
+void VoxelChunkStream::push(XYZCoordinate pos) {
+	heap.push_back({ distanceTo(pos), pos });
+	std::push_heap(heap.begin(), heap.end());
+}
+
+bool VoxelChunkStream::pop(XYZCoordinate& pos) {
+	if (heap.empty())
+		return false;
+
+	std::pop_heap(heap.begin(), heap.end());
+	pos = heap.back().pos;
+	heap.pop_back();
+
+	return true;
+}
+
+std::int64_t VoxelChunkStream::distanceTo(const XYZCoordinate& pos) const {
+	std::int64_t dx = pos[0] - origin[0];
+	std::int64_t dy = pos[1] - origin[1];
+	std::int64_t dz = pos[2] - origin[2];
+
+	return dx*dx + dy*dy + dz*dz;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// Same as in vox_voxelworld.h, we can't include that from here.
+typedef std::int32_t Coord;
+typedef std::array<Coord, 3> XYZCoordinate;
+
+// The chunks one peer still needs from a world, nearest to the peer first.
+// Kept as a binary heap on squared distance in chunks. When the peer moves into another chunk every entry
+// gets re-keyed, which is O(n), but that only happens on chunk borders.
+class VoxelChunkStream {
+public:
+	void reset(const std::vector<XYZCoordinate>& positions, XYZCoordinate origin);
+
+	void setOrigin(XYZCoordinate origin);
+
+	void push(XYZCoordinate pos);
+
+	// Drops every queued chunk keep(pos) returns false for.
+	template<typename KeepFn>
+	void filter(KeepFn keep) {
+		heap.erase(std::remove_if(heap.begin(), heap.end(), [&keep](const Entry& entry) { return !keep(entry.pos); }), heap.end());
+		std::make_heap(heap.begin(), heap.end());
+	}
+
+	// Takes the nearest chunk still queued. False once there's nothing left.
+	bool pop(XYZCoordinate& pos);
+
+	std::size_t remaining() const { return heap.size(); }
+private:
+	struct Entry {
+		std::int64_t dist;
+		XYZCoordinate pos;
+
+		// Reversed, so the std heap functions keep the nearest entry on top
+		bool operator<(const Entry& other) const { return dist > other.dist; }
+	};
+
+	std::int64_t distanceTo(const XYZCoordinate& pos) const;
+
+	std::vector<Entry> heap;
+	XYZCoordinate origin = { 0, 0, 0 };
+};
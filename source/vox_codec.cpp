@@ -0,0 +1,174 @@
+#include "vox_codec.h"
+
+#include "fastlz.h"
+
+#define CODEC_RAW_SIZE (CODEC_VOXELS * 2)
+
+// Voxels are stored x + y*16 + z*256, so going up a column is a stride of 256
+#define CODEC_COLUMN_STRIDE 256
+#define CODEC_COLUMN_HEIGHT 16
+
+const char* voxCodecName(VoxelCodec codec) {
+	switch (codec) {
+	case VCODEC_FASTLZ: return "fastlz";
+	case VCODEC_PLANES: return "planes";
+	case VCODEC_ZRLE: return "zrle";
+	default: return "unknown";
+	}
+}
+
+static int compressPlanes(const BlockData* raw, char* out) {
+	unsigned char planes[CODEC_RAW_SIZE];
+
+	for (int i = 0; i < CODEC_VOXELS; i++) {
+		planes[i] = raw[i] & 0xFF;
+		planes[CODEC_VOXELS + i] = raw[i] >> 8;
+	}
+
+	return fastlz_compress_level(2, planes, CODEC_RAW_SIZE, out);
+}
+
+static bool decompressPlanes(const char* in, int len, BlockData* out) {
+	unsigned char planes[CODEC_RAW_SIZE];
+
+	if (fastlz_decompress(in, len, planes, CODEC_RAW_SIZE) != CODEC_RAW_SIZE)
+		return false;
+
+	for (int i = 0; i < CODEC_VOXELS; i++) {
+		out[i] = planes[i] | (planes[CODEC_VOXELS + i] << 8);
+	}
+
+	return true;
+}
+
+// Run stream is (value: 2 bytes, length: 1-2 byte varint) pairs, going up each column in turn.
+// Runs carry on from the top of one column into the bottom of the next.
+// Returns 0 if the stream comes out bigger than the raw data, in which case it isn't worth it.
+static int compressZRLE(const BlockData* raw, char* out) {
+	unsigned char runs[CODEC_RAW_SIZE];
+	int runs_size = 0;
+
+	BlockData run_value = raw[0];
+	int run_length = 0;
+
+	auto flush_run = [&]() -> bool {
+		if (runs_size + 4 > CODEC_RAW_SIZE)
+			return false;
+
+		runs[runs_size++] = run_value & 0xFF;
+		runs[runs_size++] = run_value >> 8;
+
+		if (run_length < 0x80) {
+			runs[runs_size++] = run_length;
+		}
+		else {
+			runs[runs_size++] = (run_length & 0x7F) | 0x80;
+			runs[runs_size++] = run_length >> 7;
+		}
+		return true;
+	};
+
+	for (int column = 0; column < CODEC_COLUMN_STRIDE; column++) {
+		for (int z = 0; z < CODEC_COLUMN_HEIGHT; z++) {
+			BlockData d = raw[column + z*CODEC_COLUMN_STRIDE];
+
+			if (d != run_value) {
+				if (!flush_run())
+					return 0;
+
+				run_value = d;
+				run_length = 0;
+			}
+
+			run_length++;
+		}
+	}
+
+	if (!flush_run())
+		return 0;
+
+	return fastlz_compress_level(2, runs, runs_size, out);
+}
+
+static bool decompressZRLE(const char* in, int len, BlockData* out) {
+	unsigned char runs[CODEC_RAW_SIZE];
+
+	int runs_size = fastlz_decompress(in, len, runs, CODEC_RAW_SIZE);
+	if (runs_size <= 0)
+		return false;
+
+	int column = 0;
+	int z = 0;
+
+	int pos = 0;
+	while (pos < runs_size) {
+		if (pos + 3 > runs_size)
+			return false;
+
+		BlockData value = runs[pos] | (runs[pos + 1] << 8);
+		int run_length = runs[pos + 2];
+		pos += 3;
+
+		if (run_length & 0x80) {
+			if (pos >= runs_size)
+				return false;
+
+			run_length = (run_length & 0x7F) | (runs[pos++] << 7);
+		}
+
+		for (int i = 0; i < run_length; i++) {
+			if (column >= CODEC_COLUMN_STRIDE)
+				return false;
+
+			out[column + z*CODEC_COLUMN_STRIDE] = value;
+
+			if (++z == CODEC_COLUMN_HEIGHT) {
+				z = 0;
+				column++;
+			}
+		}
+	}
+
+	return column == CODEC_COLUMN_STRIDE;
+}
+
+int voxCompress(VoxelCodec codec, const BlockData* raw, char* out) {
+	int size = 0;
+
+	switch (codec) {
+	case VCODEC_ZRLE:
+		size = compressZRLE(raw, out + 1);
+		if (size > 0)
+			break;
+
+		// Too noisy to be worth run encoding
+		codec = VCODEC_PLANES;
+		// fall through
+	case VCODEC_PLANES:
+		size = compressPlanes(raw, out + 1);
+		break;
+	default:
+		codec = VCODEC_FASTLZ;
+		size = fastlz_compress(raw, CODEC_RAW_SIZE, out + 1);
+		break;
+	}
+
+	out[0] = codec;
+	return size + 1;
+}
+
+bool voxDecompress(const char* in, int len, BlockData* out) {
+	if (len < 2)
+		return false;
+
+	switch (in[0]) {
+	case VCODEC_FASTLZ:
+		return fastlz_decompress(in + 1, len - 1, out, CODEC_RAW_SIZE) == CODEC_RAW_SIZE;
+	case VCODEC_PLANES:
+		return decompressPlanes(in + 1, len - 1, out);
+	case VCODEC_ZRLE:
+		return decompressZRLE(in + 1, len - 1, out);
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+// Same as in vox_voxelworld.h, we can't include that from here.
+typedef std::uint16_t BlockData;
+
+#define CODEC_VOXELS (16*16*16)
+
+// Biggest a compressed chunk can get. FastLZ can grow incompressible data by about 5%, plus our codec byte.
+#define CODEC_MAX_COMPRESSED_SIZE 9000
+
+// How chunks get compressed for the network and saves. The first byte of every compressed chunk says which codec made it,
+// so anything decodes no matter what the world is set to, and a codec can fall back to another one when it does badly.
+enum VoxelCodec {
+	// FastLZ straight over the raw array, which is what we always used to do. The interleaved
+	// high and low bytes make for short matches, so it's kept mostly to compare against.
+	VCODEC_FASTLZ = 0,
+
+	// All the low bytes, then all the high bytes, then FastLZ level 2. With less than 256 types the high half is all zeros.
+	VCODEC_PLANES = 1,
+
+	// Runs of the same voxel going up each column, then FastLZ level 2. Terrain columns are usually just a few runs.
+	VCODEC_ZRLE = 2,
+
+	VCODEC_COUNT
+};
+
+#define VCODEC_DEFAULT VCODEC_ZRLE
+
+const char* voxCodecName(VoxelCodec codec);
+
+// Compresses CODEC_VOXELS values, returns the compressed size. out needs CODEC_MAX_COMPRESSED_SIZE bytes.
+int voxCompress(VoxelCodec codec, const BlockData* raw, char* out);
+
+// Fills out with CODEC_VOXELS values. False if the data is bad.
+bool voxDecompress(const char* in, int len, BlockData* out);
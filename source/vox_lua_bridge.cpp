@@ -16,7 +16,10 @@
 
 #include "GarrysMod/LuaHelpers.hpp"
 
+#include "sn_ucharptr.hpp"
+
 #include <tuple>
+#include <cstring>
 
 using namespace GarrysMod::Lua;
 
@@ -152,12 +155,34 @@ int luaf_voxNewWorld(lua_State* state) {
 		else {
 			config.atlasHeight = 1;
 		}
+
+		// Render vertices only have a byte for each tile coordinate, see emitQuadVertices
+		if (config.atlasWidth > 256 || config.atlasHeight > 256)
+			vox_print("Atlas %s is bigger than 256x256 tiles, tiles past that won't draw right.", temp_mat_name);
 	}
 
+	// Interest management, see VoxelConfig
+	config.viewRadius = config_num(state, "viewRadius", 0);
+	config.viewHysteresis = config_num(state, "viewHysteresis", 2);
+	config.maxLoadedChunks = config_num(state, "maxLoadedChunks", 8192);
+
 	// Mesh building options
 	config.buildPhysicsMesh = config_bool(state, "buildPhysicsMesh",false);
 	config.buildExterior = config_bool(state, "buildExterior", false);
 
+	// Only matters to whoever sends chunks, everything decodes whatever codec it gets
+	const char* codec_name = config_string(state, "codec", voxCodecName(VCODEC_DEFAULT));
+	for (int i = 0; i < VCODEC_COUNT; i++) {
+		if (strcmp(codec_name, voxCodecName((VoxelCodec)i)) == 0)
+			config.codec = (VoxelCodec)i;
+	}
+
+	const char* generator_name = config_string(state, "generator", voxGeneratorName(VGEN_DEFAULT));
+	for (int i = 0; i < VGEN_COUNT; i++) {
+		if (strcmp(generator_name, voxGeneratorName((VoxelGenerator)i)) == 0)
+			config.generator = (VoxelGenerator)i;
+	}
+
 	// The rest of this is going to have to wait...
 	LUA->GetField(1, "voxelTypes");
 	if (LUA->IsType(-1, GarrysMod::Lua::Type::TABLE)) {
@@ -381,16 +406,75 @@ int luaf_voxSet(lua_State* state) {
 	return 0;
 }
 
+// Lua numbers can be anything. Turning one past VOXEL_COORD_LIMIT into a Coord, or adding it to another, could overflow.
+static bool fillCoordOk(double v) {
+	return v >= -VOXEL_COORD_LIMIT && v <= VOXEL_COORD_LIMIT;
+}
+
+// voxSetRegion(index, x, y, z, sx, sy, sz, d) sets everything from x,y,z to x+sx,y+sy,z+sz, inclusive
+int luaf_voxSetRegion(lua_State* state) {
+	int index = LUA->GetNumber(1);
+
+	double x = LUA->CheckNumber(2);
+	double y = LUA->CheckNumber(3);
+	double z = LUA->CheckNumber(4);
+	double sx = LUA->CheckNumber(5);
+	double sy = LUA->CheckNumber(6);
+	double sz = LUA->CheckNumber(7);
+	int d = LUA->CheckNumber(8);
+
+	if (!fillCoordOk(x) || !fillCoordOk(y) || !fillCoordOk(z) || !fillCoordOk(sx) || !fillCoordOk(sy) || !fillCoordOk(sz) ||
+		!fillCoordOk(x + sx) || !fillCoordOk(y + sy) || !fillCoordOk(z + sz))
+		return 0;
+
+	Coord min_x = (Coord)x;
+	Coord min_y = (Coord)y;
+	Coord min_z = (Coord)z;
+
+	VoxelWorld* v = getIndexedVoxelWorld(index);
+	if (v != nullptr) {
+		if (v->fillRegion(min_x, min_y, min_z, min_x + (Coord)sx, min_y + (Coord)sy, min_z + (Coord)sz, d)) {
+			LUA->PushBool(true);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// voxSetSphere(index, x, y, z, r, d)
+int luaf_voxSetSphere(lua_State* state) {
+	int index = LUA->GetNumber(1);
+
+	double x = LUA->CheckNumber(2);
+	double y = LUA->CheckNumber(3);
+	double z = LUA->CheckNumber(4);
+	double r = LUA->CheckNumber(5);
+	int d = LUA->CheckNumber(6);
+
+	// fillSphere checks the bounds itself, these only have to fit in a Coord
+	if (!fillCoordOk(x) || !fillCoordOk(y) || !fillCoordOk(z) || !fillCoordOk(r))
+		return 0;
+
+	VoxelWorld* v = getIndexedVoxelWorld(index);
+	if (v != nullptr) {
+		if (v->fillSphere((Coord)x, (Coord)y, (Coord)z, (Coord)r, d)) {
+			LUA->PushBool(true);
+			return 1;
+		}
+	}
+	return 0;
+}
+
 int luaf_voxUpdate(lua_State* state) {
 	int index = LUA->GetNumber(1);
-	int chunk_count = LUA->GetNumber(2);
+	double time_budget = LUA->GetNumber(2); // milliseconds
 
 	CBaseEntity* ent = elua_getEntity(state, 3);
 
 	VoxelWorld* v = getIndexedVoxelWorld(index);
 
 	if (v != nullptr) {
-		v->doUpdates(chunk_count, ent);
+		v->doUpdates(time_budget, ent);
 	}
 
 	return 0;
@@ -461,11 +545,12 @@ int luaf_voxSendChunks(lua_State* state) {
 	int y = LUA->GetNumber(4);
 	int z = LUA->GetNumber(5);
 	int radius = LUA->GetNumber(6);
+	int packet_size = LUA->GetNumber(7); // optional, 0 = default
 
 	VoxelWorld* v = getIndexedVoxelWorld(index);
 
 	if (v != nullptr) {
-		lua_pushboolean(state, v->sendChunksAround(peerID, {x, y, z}, radius));
+		lua_pushboolean(state, v->sendChunksAround(peerID, {x, y, z}, radius, packet_size));
 	}
 	else {
 		lua_pushboolean(state, false);
@@ -473,48 +558,134 @@ int luaf_voxSendChunks(lua_State* state) {
 
 	return 1;
 }
-#endif
 
-int luaf_voxSaveToString1(lua_State* state) { // save with format 1
-	// int index = LUA->GetNumber(1);
+// voxStreamStart(index, peerID, origin) queues every chunk to be sent to the peer, see VoxelWorld::streamStart
+int luaf_voxStreamStart(lua_State* state) {
+	int index = LUA->GetNumber(1);
+	int peerID = LUA->GetNumber(2);
+
+	VoxelWorld* v = getIndexedVoxelWorld(index);
+
+	if (v != nullptr) {
+		v->streamStart(peerID, elua_getVector(state, 3));
+	}
+
+	return 0;
+}
+
+// voxStreamUpdate(index, peerID, origin, byteBudget) -> chunks left to send
+int luaf_voxStreamUpdate(lua_State* state) {
+	int index = LUA->GetNumber(1);
+	int peerID = LUA->GetNumber(2);
+	int byte_budget = LUA->GetNumber(4);
+
+	VoxelWorld* v = getIndexedVoxelWorld(index);
 
-	// VoxelWorld* v = getIndexedVoxelWorld(index);
-	// if (v != nullptr) {
-	// 	auto ret = v->writeToString();
-	// 	auto data = std::get<0>(ret);
-	// 	auto size = std::get<1>(ret);
+	if (v != nullptr) {
+		LUA->PushNumber(v->streamUpdate(peerID, elua_getVector(state, 3), byte_budget));
+	}
+	else {
+		LUA->PushNumber(0);
+	}
 
-	// 	lua_pushlstring(state, data, size);
+	return 1;
+}
+
+int luaf_voxStreamStop(lua_State* state) {
+	int index = LUA->GetNumber(1);
+	int peerID = LUA->GetNumber(2);
 
-	// 	delete[size] data;
+	VoxelWorld* v = getIndexedVoxelWorld(index);
 
-	// 	return 1;
-	// }
+	if (v != nullptr) {
+		v->streamStop(peerID);
+	}
 
 	return 0;
 }
 
-int luaf_voxLoadFromString1(lua_State* state) { // save with format 1
-	// int index = LUA->GetNumber(1);
+// voxFlushEdits(index) packs up everything set since the last flush, returns true if there's anything to send
+int luaf_voxFlushEdits(lua_State* state) {
+	int index = LUA->GetNumber(1);
 
-	// VoxelWorld* v = getIndexedVoxelWorld(index);
-	// if (v != nullptr) {
-	// 	size_t size;
+	VoxelWorld* v = getIndexedVoxelWorld(index);
 
-	// 	auto Ldata = luaL_checklstring(state, 2, &size);
+	LUA->PushBool(v != nullptr && v->flushEdits());
 
-	// 	std::string data(Ldata, size);
+	return 1;
+}
 
-	// 	auto success = v->loadFromString(data);
+// voxSendEdits(index, peerID) sends the edits from the last flush
+int luaf_voxSendEdits(lua_State* state) {
+	int index = LUA->GetNumber(1);
+	int peerID = LUA->GetNumber(2);
 
-	// 	lua_pushboolean(state, success);
+	VoxelWorld* v = getIndexedVoxelWorld(index);
 
-	// 	return 1;
-	// }
+	if (v != nullptr) {
+		v->sendEdits(peerID);
+	}
 
 	return 0;
 }
 
+// Save directories are names under garrysmod/data, same place Lua's file library writes. Nothing that could climb out of it.
+static bool save_dir(lua_State* state, int arg, std::string& out) {
+	const char* name = LUA->GetString(arg);
+
+	if (name == nullptr || name[0] == '\0' || name[0] == '/' || name[0] == '\\' || strstr(name, "..") != nullptr || strchr(name, ':') != nullptr)
+		return false;
+
+	out = std::string("garrysmod/data/") + name;
+	return true;
+}
+
+// voxSave(index, dir) starts saving chunks that changed since the last save, returns false if it can't. Make dir with file.CreateDir first.
+int luaf_voxSave(lua_State* state) {
+	int index = LUA->GetNumber(1);
+
+	VoxelWorld* v = getIndexedVoxelWorld(index);
+	std::string dir;
+
+	LUA->PushBool(v != nullptr && save_dir(state, 2, dir) && v->save(dir));
+	return 1;
+}
+
+// voxLoad(index, dir) starts loading, returns false if it can't
+int luaf_voxLoad(lua_State* state) {
+	int index = LUA->GetNumber(1);
+
+	VoxelWorld* v = getIndexedVoxelWorld(index);
+	std::string dir;
+
+	LUA->PushBool(v != nullptr && save_dir(state, 2, dir) && v->load(dir));
+	return 1;
+}
+
+// voxPersistStatus(index) -> "save" or "load", chunks done, chunks total, finished, ok, chunks found by a load
+// Returns nothing if there's no save or load going. Finishing is only returned once.
+int luaf_voxPersistStatus(lua_State* state) {
+	int index = LUA->GetNumber(1);
+
+	VoxelWorld* v = getIndexedVoxelWorld(index);
+
+	VoxelPersistKind kind;
+	int done, total, loaded;
+	bool finished, ok;
+
+	if (v == nullptr || !v->getPersistStatus(kind, done, total, finished, ok, loaded))
+		return 0;
+
+	LUA->PushString(kind == VPERSIST_SAVE ? "save" : "load");
+	LUA->PushNumber(done);
+	LUA->PushNumber(total);
+	LUA->PushBool(finished);
+	LUA->PushBool(ok);
+	LUA->PushNumber(loaded);
+	return 6;
+}
+#endif
+
 int luaf_voxTrace(lua_State* state) {
 	int index = LUA->GetNumber(1);
 
@@ -544,6 +715,43 @@ int luaf_voxTrace(lua_State* state) {
 	return 0;
 }
 
+// Batched version of the above, for when lua wants a few hundred traces at once.
+// voxTraceMany(index, traces, isBox, extents, parallel) -> results
+// traces is a string or UCHARPTR of packed floats, 6 per trace: start xyz, delta xyz.
+// results is a string of packed floats, 7 per trace: fraction, hit pos xyz, hit normal xyz. Fraction is -1 on a miss.
+int luaf_voxTraceMany(lua_State* state) {
+	int index = LUA->GetNumber(1);
+
+	VoxelWorld* v = getIndexedVoxelWorld(index);
+	if (v != nullptr) {
+		const unsigned char* in;
+		size_t in_size;
+
+		if (LUA->IsType(2, UCHARPTR::metatype)) {
+			int32_t bits;
+			in = UCHARPTR::Get(LUA, 2, &bits);
+			in_size = bits / 8;
+		}
+		else {
+			in = reinterpret_cast<const unsigned char*>(luaL_checklstring(state, 2, &in_size));
+		}
+
+		int count = in_size / (6 * sizeof(float));
+
+		bool isHull = LUA->GetBool(3);
+		Vector extents = isHull ? elua_getVector(state, 4) : Vector(0, 0, 0);
+
+		std::string results(count * 7 * sizeof(float), '\0');
+
+		v->doTraceMany(in, reinterpret_cast<unsigned char*>(&results[0]), count, isHull, extents, LUA->GetBool(5));
+
+		lua_pushlstring(state, results.c_str(), results.size());
+		return 1;
+	}
+
+	return 0;
+}
+
 void setupFiles();
 const char* grabBootstrap();
 int grabBootstrapLength();
@@ -644,6 +852,9 @@ void init_lua(lua_State* state, const char* version_string) {
 	LUA->PushCFunction(luaf_voxTrace);
 	LUA->SetField(-2, "voxTrace");
 
+	LUA->PushCFunction(luaf_voxTraceMany);
+	LUA->SetField(-2, "voxTraceMany");
+
 	/*LUA->PushCFunction(luaf_voxGenerate);
 	LUA->SetField(-2, "voxGenerate");
 
@@ -656,18 +867,18 @@ void init_lua(lua_State* state, const char* version_string) {
 	LUA->PushCFunction(luaf_voxSet);
 	LUA->SetField(-2, "voxSet");
 
+	LUA->PushCFunction(luaf_voxSetRegion);
+	LUA->SetField(-2, "voxSetRegion");
+
+	LUA->PushCFunction(luaf_voxSetSphere);
+	LUA->SetField(-2, "voxSetSphere");
+
 	/*LUA->PushCFunction(luaf_voxGetWorldUpdates); for real? fuck off
 	LUA->SetField(-2, "voxGetWorldUpdates");
 
 	LUA->PushCFunction(luaf_voxSetWorldUpdatesEnabled);
 	LUA->SetField(-2, "voxSetWorldUpdatesEnabled");*/
 
-	LUA->PushCFunction(luaf_voxLoadFromString1);
-	LUA->SetField(-2, "voxLoadFromString1");
-
-	LUA->PushCFunction(luaf_voxSaveToString1);
-	LUA->SetField(-2, "voxSaveToString1");
-
 	LUA->PushString(version_string);
 	LUA->SetField(-2, "VERSION");
 
@@ -677,6 +888,30 @@ void init_lua(lua_State* state, const char* version_string) {
 
 	LUA->PushCFunction(luaf_voxSendChunks);
 	LUA->SetField(-2, "voxSendChunks");
+
+	LUA->PushCFunction(luaf_voxStreamStart);
+	LUA->SetField(-2, "voxStreamStart");
+
+	LUA->PushCFunction(luaf_voxStreamUpdate);
+	LUA->SetField(-2, "voxStreamUpdate");
+
+	LUA->PushCFunction(luaf_voxStreamStop);
+	LUA->SetField(-2, "voxStreamStop");
+
+	LUA->PushCFunction(luaf_voxFlushEdits);
+	LUA->SetField(-2, "voxFlushEdits");
+
+	LUA->PushCFunction(luaf_voxSendEdits);
+	LUA->SetField(-2, "voxSendEdits");
+
+	LUA->PushCFunction(luaf_voxSave);
+	LUA->SetField(-2, "voxSave");
+
+	LUA->PushCFunction(luaf_voxLoad);
+	LUA->SetField(-2, "voxLoad");
+
+	LUA->PushCFunction(luaf_voxPersistStatus);
+	LUA->SetField(-2, "voxPersistStatus");
 #endif
 
 #ifdef VOXELATE_LUA_HOTLOADING
@@ -0,0 +1,322 @@
+#include "vox_mesher.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static inline int countTrailingZeros(std::uint32_t v) {
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward(&i, v);
+	return i;
+#else
+	return __builtin_ctz(v);
+#endif
+}
+
+// Faces in a slice that share a texture and direction, one bit per face.
+struct SliceFaceGroup {
+	AtlasPos texture;
+	bool direction;
+	std::uint16_t rows[VOXEL_CHUNK_SIZE];
+};
+
+// Same merging as buildSlice, but on bitmasks. Scans in the same order and grows quads the same way, so the output is identical.
+static void buildSliceBinary(int slice, std::uint8_t dir, SliceFaceGroup* groups, std::uint8_t group_of[VOXEL_CHUNK_SIZE][VOXEL_CHUNK_SIZE],
+	std::uint16_t* any_rows, int row_count, std::vector<VoxelQuad>& quads) {
+
+	for (int y = 0; y < row_count; y++) {
+		while (any_rows[y] != 0) {
+			int x = countTrailingZeros(any_rows[y]);
+
+			SliceFaceGroup& group = groups[group_of[y][x]];
+			std::uint16_t* rows = group.rows;
+
+			// Length of the run of set bits starting at x. Bits past the row are zero, so this stops at 16 at most.
+			int w = countTrailingZeros(~((std::uint32_t)rows[y] >> x));
+			std::uint16_t span = ((1u << w) - 1) << x;
+
+			rows[y] &= ~span;
+			any_rows[y] &= ~span;
+
+			int end_y;
+			for (end_y = y + 1; end_y < row_count && (rows[end_y] & span) == span; end_y++) {
+				rows[end_y] &= ~span;
+				any_rows[end_y] &= ~span;
+			}
+
+			VoxelQuad quad;
+			quad.slice = slice;
+			quad.x = x;
+			quad.y = y;
+			quad.w = w;
+			quad.h = end_y - y;
+			quad.dir = group.direction ? dir : dir + 3;
+			quad.tx = group.texture.x;
+			quad.ty = group.texture.y;
+
+			quads.push_back(quad);
+		}
+	}
+}
+
+// Meshes one slice, given the solidity rows on either side of it.
+// A face exists wherever exactly one side is solid, so a whole row is just base & ~next (or the reverse for back faces).
+// texture(column, row, positive) only gets called for faces that actually exist.
+template<typename TextureFn>
+static void meshSlice(int slice, std::uint8_t dir, const std::uint16_t* base_rows, const std::uint16_t* next_rows, int column_count, int row_count,
+	bool textured, TextureFn texture, VoxelMesher mesher, std::vector<VoxelQuad>& quads) {
+
+	std::uint16_t column_mask = (1u << column_count) - 1;
+
+	std::uint16_t pos_rows[VOXEL_CHUNK_SIZE];
+	std::uint16_t neg_rows[VOXEL_CHUNK_SIZE];
+
+	// Kept dead simple so the compiler can vectorize it
+	for (int row = 0; row < VOXEL_CHUNK_SIZE; row++) {
+		pos_rows[row] = base_rows[row] & ~next_rows[row] & column_mask;
+		neg_rows[row] = ~base_rows[row] & next_rows[row] & column_mask;
+	}
+
+	if (mesher == VMESHER_NAIVE) {
+		SliceFace faces[VOXEL_CHUNK_SIZE][VOXEL_CHUNK_SIZE];
+
+		for (int row = 0; row < row_count; row++) {
+			for (int col = 0; col < VOXEL_CHUNK_SIZE; col++) {
+				faces[row][col].present = false;
+			}
+
+			std::uint32_t bits = pos_rows[row];
+			while (bits != 0) {
+				int col = countTrailingZeros(bits);
+				bits &= bits - 1;
+
+				SliceFace& face = faces[row][col];
+				face.present = true;
+				face.direction = true;
+				face.texture = textured ? texture(col, row, true) : AtlasPos(0, 0);
+			}
+
+			bits = neg_rows[row];
+			while (bits != 0) {
+				int col = countTrailingZeros(bits);
+				bits &= bits - 1;
+
+				SliceFace& face = faces[row][col];
+				face.present = true;
+				face.direction = !textured; // physics meshes get everything facing the same way
+				face.texture = textured ? texture(col, row, false) : AtlasPos(0, 0);
+			}
+		}
+
+		buildSlice(slice, dir, faces, column_count, row_count, quads);
+		return;
+	}
+
+	// Worst case every face is different
+	SliceFaceGroup groups[VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
+	int group_count = 0;
+	int last_group = -1;
+
+	std::uint8_t group_of[VOXEL_CHUNK_SIZE][VOXEL_CHUNK_SIZE];
+	std::uint16_t any_rows[VOXEL_CHUNK_SIZE];
+
+	auto addFace = [&](int col, int row, bool direction, AtlasPos tex) {
+		if (last_group == -1 || groups[last_group].direction != direction || groups[last_group].texture.x != tex.x || groups[last_group].texture.y != tex.y) {
+			last_group = -1;
+			for (int i = 0; i < group_count; i++) {
+				if (groups[i].direction == direction && groups[i].texture.x == tex.x && groups[i].texture.y == tex.y) {
+					last_group = i;
+					break;
+				}
+			}
+
+			if (last_group == -1) {
+				SliceFaceGroup& group = groups[group_count];
+				group.texture = tex;
+				group.direction = direction;
+				for (int i = 0; i < VOXEL_CHUNK_SIZE; i++)
+					group.rows[i] = 0;
+
+				last_group = group_count++;
+			}
+		}
+
+		groups[last_group].rows[row] |= 1 << col;
+		group_of[row][col] = last_group;
+	};
+
+	// Physics faces all look the same, so they all go in one group and we skip the lookups entirely
+	if (!textured) {
+		groups[0].texture = AtlasPos(0, 0);
+		groups[0].direction = true;
+		group_count = 1;
+	}
+
+	for (int row = 0; row < row_count; row++) {
+		any_rows[row] = pos_rows[row] | neg_rows[row];
+
+		if (!textured) {
+			groups[0].rows[row] = any_rows[row];
+
+			for (int col = 0; col < VOXEL_CHUNK_SIZE; col++)
+				group_of[row][col] = 0;
+			continue;
+		}
+
+		std::uint32_t bits = pos_rows[row];
+		while (bits != 0) {
+			int col = countTrailingZeros(bits);
+			bits &= bits - 1;
+
+			addFace(col, row, true, texture(col, row, true));
+		}
+
+		bits = neg_rows[row];
+		while (bits != 0) {
+			int col = countTrailingZeros(bits);
+			bits &= bits - 1;
+
+			addFace(col, row, false, texture(col, row, false));
+		}
+	}
+
+	buildSliceBinary(slice, dir, groups, group_of, any_rows, row_count, quads);
+}
+
+void unpackMeshInput(const VoxelChunkSnapshot& snap, VoxelMeshInput& input) {
+	snap.center->unpack(input.voxels);
+
+	const PalettedBlockStorage* next_x = snap.neighbors[1].get();
+	const PalettedBlockStorage* next_y = snap.neighbors[3].get();
+	const PalettedBlockStorage* next_z = snap.neighbors[5].get();
+
+	for (int a = 0; a < VOXEL_CHUNK_SIZE; a++) {
+		for (int b = 0; b < VOXEL_CHUNK_SIZE; b++) {
+			input.next_x[a + b*VOXEL_CHUNK_SIZE] = next_x != nullptr ? next_x->get(a*VOXEL_CHUNK_SIZE + b*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE) : 0;
+			input.next_y[a + b*VOXEL_CHUNK_SIZE] = next_y != nullptr ? next_y->get(a + b*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE) : 0;
+			input.next_z[a + b*VOXEL_CHUNK_SIZE] = next_z != nullptr ? next_z->get(a + b*VOXEL_CHUNK_SIZE) : 0;
+		}
+	}
+}
+
+// Runs on worker threads! Don't touch anything that isn't in the input.
+void buildChunkMesh(const VoxelMeshInput& input, std::vector<VoxelQuad>& quads, VoxelMesher mesher) {
+	const VoxelType* blockTypes = input.voxelTypes;
+	const BlockData* voxels = input.voxels;
+
+	bool textured = input.textured;
+
+	int upper_bound_x = input.upper_bound_x;
+	int upper_bound_y = input.upper_bound_y;
+	int upper_bound_z = input.upper_bound_z;
+
+	// Solidity masks, one row of bits per line of voxels, for each axis we slice along.
+	// Index 0 is the (always empty) slice below the chunk, 1-16 are the chunk itself, 17 is the neighbor.
+	// solid_x[x+1][z] has bit y set if (x,y,z) is solid, solid_y[y+1][z] bit x, solid_z[z+1][y] bit x.
+	std::uint16_t solid_x[VOXEL_CHUNK_SIZE + 2][VOXEL_CHUNK_SIZE] = {};
+	std::uint16_t solid_y[VOXEL_CHUNK_SIZE + 2][VOXEL_CHUNK_SIZE] = {};
+	std::uint16_t solid_z[VOXEL_CHUNK_SIZE + 2][VOXEL_CHUNK_SIZE] = {};
+
+	for (int z = 0; z < VOXEL_CHUNK_SIZE; z++) {
+		for (int y = 0; y < VOXEL_CHUNK_SIZE; y++) {
+			for (int x = 0; x < VOXEL_CHUNK_SIZE; x++) {
+				if (blockTypes[voxels[x + y*VOXEL_CHUNK_SIZE + z*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE]].form == VFORM_CUBE) {
+					solid_x[x + 1][z] |= 1 << y;
+					solid_y[y + 1][z] |= 1 << x;
+					solid_z[z + 1][y] |= 1 << x;
+				}
+			}
+		}
+	}
+
+	for (int a = 0; a < VOXEL_CHUNK_SIZE; a++) {
+		for (int b = 0; b < VOXEL_CHUNK_SIZE; b++) {
+			if (blockTypes[input.next_x[a + b*VOXEL_CHUNK_SIZE]].form == VFORM_CUBE)
+				solid_x[VOXEL_CHUNK_SIZE + 1][b] |= 1 << a;
+			if (blockTypes[input.next_y[a + b*VOXEL_CHUNK_SIZE]].form == VFORM_CUBE)
+				solid_y[VOXEL_CHUNK_SIZE + 1][b] |= 1 << a;
+			if (blockTypes[input.next_z[a + b*VOXEL_CHUNK_SIZE]].form == VFORM_CUBE)
+				solid_z[VOXEL_CHUNK_SIZE + 1][b] |= 1 << a;
+		}
+	}
+
+	auto voxelAt = [&](int x, int y, int z) -> BlockData {
+		if (x == VOXEL_CHUNK_SIZE)
+			return input.next_x[y + z*VOXEL_CHUNK_SIZE];
+		if (y == VOXEL_CHUNK_SIZE)
+			return input.next_y[x + z*VOXEL_CHUNK_SIZE];
+		if (z == VOXEL_CHUNK_SIZE)
+			return input.next_z[x + y*VOXEL_CHUNK_SIZE];
+		return voxels[x + y*VOXEL_CHUNK_SIZE + z*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
+	};
+
+	// Slices along x axis! Rows are z, columns are y.
+	for (int slice_x = input.lower_slice_x; slice_x < input.upper_slice_x; slice_x++) {
+		meshSlice(slice_x, DIR_X_POS, solid_x[slice_x + 1], solid_x[slice_x + 2], upper_bound_y, upper_bound_z, textured,
+			[&](int y, int z, bool positive) {
+				return positive ? blockTypes[voxelAt(slice_x, y, z)].side_xPos : blockTypes[voxelAt(slice_x + 1, y, z)].side_xNeg;
+			}, mesher, quads);
+	}
+
+	// Slices along y axis! Rows are z, columns are x.
+	for (int slice_y = input.lower_slice_y; slice_y < input.upper_slice_y; slice_y++) {
+		meshSlice(slice_y, DIR_Y_POS, solid_y[slice_y + 1], solid_y[slice_y + 2], upper_bound_x, upper_bound_z, textured,
+			[&](int x, int z, bool positive) {
+				return positive ? blockTypes[voxelAt(x, slice_y, z)].side_yPos : blockTypes[voxelAt(x, slice_y + 1, z)].side_yNeg;
+			}, mesher, quads);
+	}
+
+	// Slices along z axis! Rows are y, columns are x. TODO ALSO PROCESS NON-CUBIC BLOCKS IN -THIS- STAGE
+	for (int slice_z = input.lower_slice_z; slice_z < input.upper_slice_z; slice_z++) {
+		meshSlice(slice_z, DIR_Z_POS, solid_z[slice_z + 1], solid_z[slice_z + 2], upper_bound_x, upper_bound_y, textured,
+			[&](int x, int y, bool positive) {
+				return positive ? blockTypes[voxelAt(x, y, slice_z)].side_zPos : blockTypes[voxelAt(x, y, slice_z + 1)].side_zNeg;
+			}, mesher, quads);
+	}
+}
+
+void buildSlice(int slice, std::uint8_t dir, SliceFace faces[VOXEL_CHUNK_SIZE][VOXEL_CHUNK_SIZE], int upper_bound_x, int upper_bound_y, std::vector<VoxelQuad>& quads) {
+
+	for (int y = 0; y < upper_bound_y; y++) {
+		for (int x = 0; x < upper_bound_x; x++) {
+
+			if (faces[y][x].present) {
+				SliceFace& current_face = faces[y][x];
+
+				int end_x;
+				int end_y;
+
+				for (end_x = x + 1; end_x < upper_bound_x && current_face == faces[y][end_x]; end_x++) {
+					faces[y][end_x].present = false;
+				}
+
+				for (end_y = y + 1; end_y < upper_bound_y; end_y++) {
+					for (int ix = x; ix < end_x; ix++) {
+						if (!(current_face == faces[end_y][ix]))
+							goto bail;
+					}
+
+					for (int ix = x; ix < end_x; ix++) {
+						faces[end_y][ix].present = false;
+					}
+				}
+			bail:
+
+				current_face.present = false;
+
+				VoxelQuad quad;
+				quad.slice = slice;
+				quad.x = x;
+				quad.y = y;
+				quad.w = end_x - x;
+				quad.h = end_y - y;
+				quad.dir = current_face.direction ? dir : dir + 3;
+				quad.tx = current_face.texture.x;
+				quad.ty = current_face.texture.y;
+
+				quads.push_back(quad);
+			}
+		}
+	}
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "vox_voxelworld.h"
+
+// Engine-independent chunk meshing.
+// The game thread pins a snapshot of a chunk and its neighbors, a worker unpacks that into a VoxelMeshInput
+// (the chunk + the faces of its +X/+Y/+Z neighbors) and turns it into a list of quads, and the game thread copies the quads into engine meshes.
+
+struct SliceFace {
+	bool present;
+	bool direction;
+	AtlasPos texture;
+
+	bool operator== (const SliceFace& other) const {
+		return
+			present == other.present &&
+			direction == other.direction &&
+			texture.x == other.texture.x &&
+			texture.y == other.texture.y;
+	}
+};
+
+// One greedy-merged face. Coordinates are in slice space, see emitQuadVertices
+struct VoxelQuad {
+	std::int8_t slice;
+	std::uint8_t x, y, w, h;
+	std::uint8_t dir;
+	std::int16_t tx, ty;
+};
+
+// Source indexes meshes with 16 bit indices, so this is as many quads as one mesh can take.
+#define MESH_MAX_QUADS (65536 / 4)
+
+// Most quads a chunk can come out with. A face needs exactly one solid side, so each slice has at most one per voxel,
+// and there are 17 slices per axis when the world's exterior gets built. Comfortably fits in one mesh.
+#define MESH_WORST_CASE_QUADS (3 * (VOXEL_CHUNK_SIZE + 1) * VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE)
+
+struct VoxelMeshInput {
+	BlockData voxels[VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
+
+	// Touching faces of the neighboring chunks, all air if the neighbor doesn't exist.
+	// next_x is indexed [y + z*SIZE], next_y [x + z*SIZE], next_z [x + y*SIZE]
+	BlockData next_x[VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
+	BlockData next_y[VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
+	BlockData next_z[VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
+
+	int upper_bound_x, upper_bound_y, upper_bound_z;
+	int lower_slice_x, lower_slice_y, lower_slice_z;
+	int upper_slice_x, upper_slice_y, upper_slice_z;
+
+	// Physics meshes don't care about textures or facing, which lets them merge a lot more
+	bool textured;
+
+	// Must stay alive until the job is done. Points into the world config, which never changes.
+	const VoxelType* voxelTypes;
+};
+
+// Handed to the workers by VoxelWorld::doUpdates, and handed back once quads is filled in
+struct VoxelMeshJob {
+	XYZCoordinate pos;
+	int generation;
+
+	VoxelChunkSnapshot snapshot;
+	VoxelMeshInput input;
+	std::vector<VoxelQuad> quads;
+};
+
+// Both produce exactly the same quads. The naive one is only kept around to check against and benchmark.
+enum VoxelMesher {
+	VMESHER_NAIVE,
+	VMESHER_BINARY
+};
+
+#ifdef VOXELATE_NAIVE_MESHER
+#define VMESHER_DEFAULT VMESHER_NAIVE
+#else
+#define VMESHER_DEFAULT VMESHER_BINARY
+#endif
+
+// Copies the voxels the mesher needs out of a snapshot. Fine to run on a worker.
+void unpackMeshInput(const VoxelChunkSnapshot& snap, VoxelMeshInput& input);
+
+void buildChunkMesh(const VoxelMeshInput& input, std::vector<VoxelQuad>& quads, VoxelMesher mesher = VMESHER_DEFAULT);
+
+void buildSlice(int slice, std::uint8_t dir, SliceFace faces[VOXEL_CHUNK_SIZE][VOXEL_CHUNK_SIZE], int upper_bound_x, int upper_bound_y, std::vector<VoxelQuad>& quads);
+
+
+// Turning quads into geometry. Templated on where the geometry goes, so the same code can feed
+// the engine (CMeshBuilder, IPhysicsCollision polysoups) or the stub sinks in the benchmark.
+
+// Render vertices are compact, 16 bytes each (see VOXEL_VERT_FMT):
+//  - Position: float3, chunk local, in voxels. Always whole numbers from 0 to VOXEL_CHUNK_SIZE.
+//    The chunk's offset and the world's scale go in the model matrix instead, see VoxelChunk::draw.
+//  - Color: r = direction (DIR_*), g/b = atlas tile x/y, a unused.
+// voxels_vs20.fxc works out the normal, texture coordinates and tile from those.
+// The benchmark decodes them the same way and checks them against the old 56 byte format.
+
+// Builder needs CMeshBuilder's Position3f, Color4ub and AdvanceVertex. Always emits 4 verts.
+// Tile coordinates past 255 don't fit, there's a warning for atlases that big when the world is made.
+template<typename MeshBuilderT>
+void emitQuadVertices(MeshBuilderT& builder, const VoxelQuad& quad) {
+	// Same corners, in the same order, as the old float format (emitQuadVerticesFloat in the benchmark)
+	float s = quad.slice + 1;
+	float x0 = quad.x;
+	float y0 = quad.y;
+	float x1 = quad.x + quad.w;
+	float y1 = quad.y + quad.h;
+
+	float corners[4][3];
+
+	auto corner = [&corners](int i, float x, float y, float z) {
+		corners[i][0] = x;
+		corners[i][1] = y;
+		corners[i][2] = z;
+	};
+
+	switch (quad.dir) {
+	case DIR_X_POS:
+		corner(0, s, x0, y0); corner(1, s, x0, y1); corner(2, s, x1, y1); corner(3, s, x1, y0);
+		break;
+	case DIR_X_NEG:
+		corner(0, s, x0, y0); corner(1, s, x1, y0); corner(2, s, x1, y1); corner(3, s, x0, y1);
+		break;
+	case DIR_Y_POS:
+		corner(0, x0, s, y0); corner(1, x1, s, y0); corner(2, x1, s, y1); corner(3, x0, s, y1);
+		break;
+	case DIR_Y_NEG:
+		corner(0, x0, s, y0); corner(1, x0, s, y1); corner(2, x1, s, y1); corner(3, x1, s, y0);
+		break;
+	case DIR_Z_POS:
+		corner(0, x0, y0, s); corner(1, x0, y1, s); corner(2, x1, y1, s); corner(3, x1, y0, s);
+		break;
+	case DIR_Z_NEG:
+		corner(0, x0, y0, s); corner(1, x1, y0, s); corner(2, x1, y1, s); corner(3, x0, y1, s);
+		break;
+	default:
+		return;
+	}
+
+	for (int i = 0; i < 4; i++) {
+		builder.Position3f(corners[i][0], corners[i][1], corners[i][2]);
+		builder.Color4ub(quad.dir, (unsigned char)quad.tx, (unsigned char)quad.ty, 0);
+		builder.AdvanceVertex();
+	}
+}
+
+// add_triangle gets called with three Vectors, twice per quad. Physics meshes only have positive faces, everything else is skipped.
+template<typename AddTriangleFn>
+void emitQuadTriangles(AddTriangleFn add_triangle, const VoxelQuad& quad, const VoxelConfig& config, const XYZCoordinate& chunk_pos) {
+	double realStep = config.scale;
+
+	double realX;
+	double realY;
+	double realZ;
+
+	Vector v1, v2, v3, v4;
+	switch (quad.dir) {
+
+	case DIR_X_POS:
+
+		realX = (quad.slice + chunk_pos[0]*VOXEL_CHUNK_SIZE) * config.scale;
+		realY = (quad.x + chunk_pos[1]*VOXEL_CHUNK_SIZE) * config.scale;
+		realZ = (quad.y + chunk_pos[2]*VOXEL_CHUNK_SIZE) * config.scale;
+
+		v1 = Vector(realX + realStep, realY, realZ);
+		v2 = Vector(realX + realStep, realY, realZ + realStep * quad.h);
+		v3 = Vector(realX + realStep, realY + realStep * quad.w, realZ + realStep * quad.h);
+		v4 = Vector(realX + realStep, realY + realStep * quad.w, realZ);
+		break;
+
+	case DIR_Y_POS:
+
+		realX = (quad.x + chunk_pos[0]*VOXEL_CHUNK_SIZE) * config.scale;
+		realY = (quad.slice + chunk_pos[1]*VOXEL_CHUNK_SIZE) * config.scale;
+		realZ = (quad.y + chunk_pos[2]*VOXEL_CHUNK_SIZE) * config.scale;
+
+		v1 = Vector(realX, realY + realStep, realZ);
+		v2 = Vector(realX + realStep * quad.w, realY + realStep, realZ);
+		v3 = Vector(realX + realStep * quad.w, realY + realStep, realZ + realStep * quad.h);
+		v4 = Vector(realX, realY + realStep, realZ + realStep * quad.h);
+		break;
+
+	case DIR_Z_POS:
+
+		realX = (quad.x + chunk_pos[0]*VOXEL_CHUNK_SIZE) * config.scale;
+		realY = (quad.y + chunk_pos[1]*VOXEL_CHUNK_SIZE) * config.scale;
+		realZ = (quad.slice + chunk_pos[2]*VOXEL_CHUNK_SIZE) * config.scale;
+
+		v1 = Vector(realX, realY, realZ + realStep);
+		v2 = Vector(realX, realY + realStep * quad.h, realZ + realStep);
+		v3 = Vector(realX + realStep * quad.w, realY + realStep * quad.h, realZ + realStep);
+		v4 = Vector(realX + realStep * quad.w, realY, realZ + realStep);
+		break;
+
+	default:
+		return;
+	}
+
+	add_triangle(v1, v2, v3);
+	add_triangle(v1, v3, v4);
+}
@@ -0,0 +1,80 @@
+#include "vox_meshpool.h"
+
+#include "vox_engine.h"
+
+#include "materialsystem/imesh.h"
+
+VoxelMeshPool::VoxelMeshPool(int vertex_format, int max_quads) : vertex_format(vertex_format), max_quads(max_quads) {
+	int buckets = 1;
+	while (capacityOf(buckets - 1) < max_quads)
+		buckets++;
+
+	free_meshes.resize(buckets);
+}
+
+VoxelMeshPool::~VoxelMeshPool() {
+	clear();
+}
+
+VoxelPooledMesh VoxelMeshPool::acquire(int quads) {
+	int bucket = bucketFor(quads);
+
+	VoxelPooledMesh result;
+	result.capacity = capacityOf(bucket);
+
+	std::vector<IMesh*>& bucket_meshes = free_meshes[bucket];
+
+	if (!bucket_meshes.empty()) {
+		result.mesh = bucket_meshes.back();
+		bucket_meshes.pop_back();
+		reused++;
+	}
+	else {
+		CMatRenderContextPtr pRenderContext(IFACE_CL_MATERIALS);
+		result.mesh = pRenderContext->CreateStaticMesh(vertex_format, "");
+		created++;
+	}
+
+	return result;
+}
+
+void VoxelMeshPool::release(VoxelPooledMesh mesh) {
+	if (mesh.mesh == nullptr)
+		return;
+
+	std::vector<IMesh*>& bucket_meshes = free_meshes[bucketFor(mesh.capacity)];
+
+	if (bucket_meshes.size() >= MESHPOOL_MAX_FREE) {
+		destroy(mesh.mesh);
+		return;
+	}
+
+	bucket_meshes.push_back(mesh.mesh);
+}
+
+void VoxelMeshPool::clear() {
+	for (std::vector<IMesh*>& bucket_meshes : free_meshes) {
+		for (IMesh* mesh : bucket_meshes)
+			destroy(mesh);
+
+		bucket_meshes.clear();
+	}
+}
+
+int VoxelMeshPool::bucketFor(int quads) const {
+	int bucket = 0;
+	while (bucket + 1 < (int)free_meshes.size() && capacityOf(bucket) < quads)
+		bucket++;
+
+	return bucket;
+}
+
+int VoxelMeshPool::capacityOf(int bucket) const {
+	int capacity = MESHPOOL_MIN_QUADS << bucket;
+	return capacity < max_quads ? capacity : max_quads;
+}
+
+void VoxelMeshPool::destroy(IMesh* mesh) {
+	CMatRenderContextPtr pRenderContext(IFACE_CL_MATERIALS);
+	pRenderContext->DestroyStaticMesh(mesh);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+class IMesh;
+
+// Smallest mesh the pool hands out, in quads. Bigger ones double from here up to the pool's max.
+#define MESHPOOL_MIN_QUADS 64
+
+// Free meshes kept around per size, anything past this gets destroyed
+#define MESHPOOL_MAX_FREE 32
+
+struct VoxelPooledMesh {
+	IMesh* mesh = nullptr;
+
+	// Quads the vertex buffer has room for. Source sizes it on the first lock, so every lock has to ask for exactly this many.
+	int capacity = 0;
+};
+
+// Static meshes for chunks, bucketed by capacity, so rebuilding a chunk reuses vertex buffers instead of going back to the driver.
+// A chunk hangs on to its meshes and refills them in place for as long as its quads still fit, see VoxelChunk::uploadMesh.
+// Client only, game thread only.
+class VoxelMeshPool {
+public:
+	VoxelMeshPool(int vertex_format, int max_quads);
+	~VoxelMeshPool();
+
+	// A mesh with room for at least quads, which can't be more than max_quads. Reuses a free one if there is one.
+	VoxelPooledMesh acquire(int quads);
+
+	// Hands a mesh back for someone else to use.
+	void release(VoxelPooledMesh mesh);
+
+	// Destroys every free mesh.
+	void clear();
+
+	int getCreated() const { return created; }
+	int getReused() const { return reused; }
+private:
+	int bucketFor(int quads) const;
+	int capacityOf(int bucket) const;
+
+	void destroy(IMesh* mesh);
+
+	int vertex_format;
+	int max_quads;
+
+	// Bucket -> free meshes of that capacity
+	std::vector<std::vector<IMesh*>> free_meshes;
+
+	int created = 0;
+	int reused = 0;
+};
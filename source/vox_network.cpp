@@ -281,4 +281,18 @@ namespace networking {
 
 		return true;
 	}
+
+#ifdef VOXELATE_SERVER
+	ENetPacket* channelCreatePacket(size_t size, bool unreliable) {
+		return enet_packet_create(nullptr, size, unreliable ? 0 : ENET_PACKET_FLAG_RELIABLE);
+	}
+
+	bool channelSendPacket(int peerID, uint16_t channelID, ENetPacket* packet) {
+		channelID += VOX_NETWORK_CPP_CHANNEL_START;
+
+		server.send_packet_to(peerID, channelID, packet);
+
+		return true;
+	}
+#endif
 }
@@ -22,8 +22,15 @@ static enet_uint8 VOX_NETWORK_MAX_CHANNELS = 255;
 
 typedef std::function<void(int peerID, const char* data, size_t data_len)> networkCallback;
 
-#define VOX_NETWORK_CHANNEL_CHUNKDATA_SINGLE 1
-#define VOX_NETWORK_CHANNEL_CHUNKDATA_RADIUS 2
+// Chunks, unloads and edits all go out on this one channel. ENet only keeps packets in order within a channel,
+// and an edit that got ahead of its chunk would either be dropped or overwritten by the older chunk.
+#define VOX_NETWORK_CHANNEL_CHUNKDATA_SET 2
+
+// First byte after the world ID on VOX_NETWORK_CHANNEL_CHUNKDATA_SET
+// Any number of chunks in one packet, see ChunkSetSender in vox_voxelworld.cpp
+#define CHUNKSET_PACKET_CHUNKS 0
+// Batched block edits, one packet per chunk per tick, see VoxelWorld::flushEdits
+#define CHUNKSET_PACKET_EDITS 1
 
 bool network_startup();
 
@@ -34,6 +41,11 @@ void setupLuaNetworking(lua_State* state);
 namespace networking {
 #ifdef VOXELATE_SERVER
 	bool channelSend(int peerID, uint16_t channelID, void* data, int size, bool unreliable = false);
+
+	// For building big packets in place instead of copying them in. Fill in packet->data, shrink it with
+	// enet_packet_resize if needed, then hand it to channelSendPacket, which takes ownership.
+	ENetPacket* channelCreatePacket(size_t size, bool unreliable = false);
+	bool channelSendPacket(int peerID, uint16_t channelID, ENetPacket* packet);
 #else
 	bool channelSend(uint16_t channelID, void* data, int size, bool unreliable = false);
 #endif
@@ -0,0 +1,70 @@
+#include "vox_persist.h"
+
+#include "vox_regionfile.h"
+
+void runSaveJob(VoxelSaveJob* job) {
+	BlockData raw[CODEC_VOXELS];
+	char buffer[CODEC_MAX_COMPRESSED_SIZE];
+
+	for (VoxelSaveItem& item : job->items) {
+		const char* data = item.compressed.data();
+		int size = item.compressed.size();
+
+		if (item.compressed.empty()) {
+			item.data->unpack(raw);
+
+			// Let go right away, so the chunk can be edited without copying it
+			item.data.reset();
+
+			size = voxCompress(job->codec, raw, buffer);
+			data = buffer;
+		}
+
+		if (!job->store->writeChunk(item.x, item.y, item.z, data, size))
+			job->ok = false;
+
+		job->done++;
+	}
+
+	// Until this is done, the save still has the old copy of everything
+	if (!job->store->flush())
+		job->ok = false;
+
+	job->finished = true;
+}
+
+void runLoadBatch(VoxelLoadJob* job, int first, int last) {
+	std::vector<VoxelLoadedChunk>* batch = new std::vector<VoxelLoadedChunk>(last - first);
+
+	char buffer[CODEC_MAX_COMPRESSED_SIZE];
+
+	for (int i = first; i < last; i++) {
+		VoxelLoadedChunk& chunk = (*batch)[i - first];
+		chunk.pos = job->positions[i];
+
+		int len = job->store->readChunk(chunk.pos[0], chunk.pos[1], chunk.pos[2], buffer, sizeof(buffer));
+
+		chunk.found = len > 0;
+		chunk.ok = chunk.found && voxDecompress(buffer, len, chunk.raw);
+	}
+
+	std::lock_guard<std::mutex> lock(job->ready_mutex);
+	job->ready.push_back(batch);
+}
+
+void runStreamLoadBatch(std::vector<VoxelStreamLoad>& batch, VoxelRegionStore* store, VoxelGenerator generator) {
+	char buffer[CODEC_MAX_COMPRESSED_SIZE];
+
+	for (VoxelStreamLoad& load : batch) {
+		int len = 0;
+		if (store != nullptr)
+			len = store->readChunk(load.pos[0], load.pos[1], load.pos[2], buffer, sizeof(buffer));
+
+		load.corrupt = len > 0 && !voxDecompress(buffer, len, load.raw);
+
+		if (len == 0 || load.corrupt) {
+			voxGenerateChunk(generator, load.pos[0] * WORLDGEN_CHUNK_SIZE, load.pos[1] * WORLDGEN_CHUNK_SIZE, load.pos[2] * WORLDGEN_CHUNK_SIZE,
+				load.raw);
+		}
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "vox_blockstorage.h"
+#include "vox_codec.h"
+#include "vox_worldgen.h"
+
+class VoxelRegionStore;
+
+// Saving and loading happen on the I/O thread (see getIOThreadPool), see VoxelWorld::save and VoxelWorld::load.
+// The game thread only decides what goes in a save and applies what came out of a load.
+
+// One chunk headed for a save.
+struct VoxelSaveItem {
+	std::int32_t x, y, z;
+
+	// Already compressed: the chunk's cached copy, or a chunk that got evicted
+	std::string compressed;
+	bool evicted = false;
+
+	// Otherwise the chunk's voxels as they were when the save started, see ChunkDataRef.
+	// Edits after that copy the chunk instead of changing these, so a save doesn't have to copy anything up front.
+	ChunkDataRef data;
+};
+
+struct VoxelSaveJob {
+	VoxelRegionStore* store;
+	VoxelCodec codec;
+
+	std::vector<VoxelSaveItem> items;
+
+	std::atomic<int> done{ 0 };
+	std::atomic<bool> finished{ false };
+
+	// Set by the worker before finished
+	bool ok = true;
+};
+
+// Compresses and writes everything in the job, then flags it finished. Runs on the I/O thread.
+void runSaveJob(VoxelSaveJob* job);
+
+// One chunk read back from a save, ready to drop into the world.
+struct VoxelLoadedChunk {
+	std::array<std::int32_t, 3> pos;
+
+	// Was in the save at all, and decompressed fine
+	bool found;
+	bool ok;
+
+	BlockData raw[CODEC_VOXELS];
+};
+
+struct VoxelLoadJob {
+	VoxelRegionStore* store;
+
+	std::vector<std::array<std::int32_t, 3>> positions;
+
+	// Batches the workers are done with, waiting for the game thread
+	std::deque<std::vector<VoxelLoadedChunk>*> ready;
+	std::mutex ready_mutex;
+
+	// Game thread only
+	int applied = 0;
+	int loaded = 0;
+};
+
+// Reads and decompresses positions [first, last), then queues them up as one batch. Runs on the I/O thread.
+void runLoadBatch(VoxelLoadJob* job, int first, int last);
+
+// Huge worlds: a chunk that came into a peer's view without being loaded. Read from the save, or generated if it isn't in there,
+// then put in the world by VoxelWorld::updateLoads.
+struct VoxelStreamLoad {
+	std::array<std::int32_t, 3> pos;
+
+	// Only counts if the world is still waiting on this ticket, see VoxelWorld::pending_loads
+	std::uint64_t ticket;
+
+	// Was in the save but didn't decompress, so it got generated instead
+	bool corrupt;
+
+	BlockData raw[CODEC_VOXELS];
+};
+
+// Fills in every chunk in the batch. store can be nullptr if the world hasn't been saved or loaded. Runs on a worker.
+void runStreamLoadBatch(std::vector<VoxelStreamLoad>& batch, VoxelRegionStore* store, VoxelGenerator generator);
@@ -0,0 +1,424 @@
+#include "vox_regionfile.h"
+
+#include "vox_chunkindex.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define REGION_MAGIC 0x31525856 // "VXR1"
+#define REGION_VERSION 1
+
+// Chunk data starts after the header, on a sector boundary
+#define REGION_HEADER_SECTORS ((sizeof(Header) + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE)
+
+// The file grows by at least this much at a time, so appending a bunch of chunks doesn't remap it every time
+#define REGION_GROW_MIN (64 * 1024)
+
+VoxelRegionFile::~VoxelRegionFile() {
+	flush();
+	unmapFile();
+
+#ifdef _WIN32
+	if (file != nullptr)
+		CloseHandle(file);
+#else
+	if (file != -1)
+		close(file);
+#endif
+}
+
+VoxelRegionFile* VoxelRegionFile::open(const std::string& path, bool create) {
+	VoxelRegionFile* region = new VoxelRegionFile();
+	std::size_t size;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+		create ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE) {
+		delete region;
+		return nullptr;
+	}
+
+	region->file = file;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		delete region;
+		return nullptr;
+	}
+
+	size = static_cast<std::size_t>(file_size.QuadPart);
+#else
+	int file = ::open(path.c_str(), O_RDWR | (create ? O_CREAT : 0), 0644);
+
+	if (file == -1) {
+		delete region;
+		return nullptr;
+	}
+
+	region->file = file;
+
+	struct stat file_stat;
+	if (fstat(file, &file_stat) != 0) {
+		delete region;
+		return nullptr;
+	}
+
+	size = static_cast<std::size_t>(file_stat.st_size);
+#endif
+
+	bool fresh = size == 0;
+
+	if (fresh && !create) {
+		delete region;
+		return nullptr;
+	}
+
+	if (fresh)
+		size = REGION_HEADER_SECTORS * REGION_SECTOR_SIZE;
+	else if (size < sizeof(Header)) {
+		delete region;
+		return nullptr;
+	}
+
+	if (!region->mapFile(size)) {
+		delete region;
+		return nullptr;
+	}
+
+	Header* header = region->header();
+
+	if (fresh) {
+		// New space in the file is all zeros already, so every entry starts out empty
+		header->magic = REGION_MAGIC;
+		header->version = REGION_VERSION;
+	}
+	else if (header->magic != REGION_MAGIC || header->version != REGION_VERSION) {
+		delete region;
+		return nullptr;
+	}
+
+	region->buildFreeList();
+
+	return region;
+}
+
+const VoxelRegionFile::Entry& VoxelRegionFile::currentEntry(int index) const {
+	auto it = pending.find(index);
+	if (it != pending.end())
+		return it->second;
+
+	return header()->entries[index];
+}
+
+const char* VoxelRegionFile::read(int x, int y, int z, int& len) const {
+	const Entry& entry = currentEntry(x + y*REGION_SIZE + z*REGION_SIZE*REGION_SIZE);
+
+	if (entry.sector == 0)
+		return nullptr;
+
+	len = entry.length;
+	return map + (std::size_t)entry.sector * REGION_SECTOR_SIZE;
+}
+
+bool VoxelRegionFile::write(int x, int y, int z, const char* data, int len) {
+	int index = x + y*REGION_SIZE + z*REGION_SIZE*REGION_SIZE;
+
+	std::uint32_t sector = 0;
+
+	if (len > 0) {
+		// Always somewhere new, the header on disk might still point at the old copy.
+		// Allocating can remap the file, nothing from the old map is good after this
+		sector = allocate(sectorsFor(len));
+
+		if (sector == 0)
+			return false;
+
+		memcpy(map + (std::size_t)sector * REGION_SECTOR_SIZE, data, len);
+	}
+
+	// Written again before it got flushed. Nothing on disk points at the earlier write, so it can go right away
+	auto it = pending.find(index);
+	if (it != pending.end() && it->second.sector != 0)
+		release(it->second.sector, sectorsFor(it->second.length));
+
+	Entry& entry = pending[index];
+	entry.sector = sector;
+	entry.length = sector != 0 ? len : 0;
+
+	return true;
+}
+
+bool VoxelRegionFile::flush() {
+	if (map == nullptr || pending.empty())
+		return true;
+
+	std::size_t header_size = REGION_HEADER_SECTORS * REGION_SECTOR_SIZE;
+
+	// Chunk data has to be on disk before anything points at it
+	if (!syncRange(header_size, map_size - header_size))
+		return false;
+
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> replaced;
+
+	for (auto& it : pending) {
+		Entry& entry = header()->entries[it.first];
+
+		if (entry.sector != 0)
+			replaced.push_back({ entry.sector, sectorsFor(entry.length) });
+
+		entry = it.second;
+	}
+
+	pending.clear();
+
+	// If this didn't make it, the header on disk could still point at the old sectors. They stay taken until the file gets opened again.
+	if (!syncRange(0, header_size))
+		return false;
+
+	for (auto& run : replaced)
+		release(run.first, run.second);
+
+	return true;
+}
+
+bool VoxelRegionFile::mapFile(std::size_t new_size) {
+	unmapFile();
+
+#ifdef _WIN32
+	// Making a mapping bigger than the file grows the file
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, (DWORD)((std::uint64_t)new_size >> 32), (DWORD)(new_size & 0xFFFFFFFF), nullptr);
+	if (mapping == nullptr)
+		return false;
+
+	map = static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, new_size));
+	if (map == nullptr) {
+		CloseHandle(mapping);
+		mapping = nullptr;
+		return false;
+	}
+#else
+	struct stat file_stat;
+	if (fstat(file, &file_stat) != 0)
+		return false;
+
+	if ((std::size_t)file_stat.st_size < new_size && ftruncate(file, new_size) != 0)
+		return false;
+
+	void* result = mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	if (result == MAP_FAILED)
+		return false;
+
+	map = static_cast<char*>(result);
+#endif
+
+	map_size = new_size;
+	return true;
+}
+
+bool VoxelRegionFile::syncRange(std::size_t offset, std::size_t size) {
+#ifdef _WIN32
+	// FlushViewOfFile only hands the pages to the OS, FlushFileBuffers waits for the disk
+	return FlushViewOfFile(map + offset, size) && FlushFileBuffers(file);
+#else
+	// msync wants a page aligned start
+	std::size_t page = sysconf(_SC_PAGESIZE);
+	std::size_t start = offset / page * page;
+
+	return msync(map + start, offset + size - start, MS_SYNC) == 0;
+#endif
+}
+
+void VoxelRegionFile::unmapFile() {
+	if (map == nullptr)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(map);
+	CloseHandle(mapping);
+	mapping = nullptr;
+#else
+	munmap(map, map_size);
+#endif
+
+	map = nullptr;
+	map_size = 0;
+}
+
+std::uint32_t VoxelRegionFile::allocate(std::uint32_t count) {
+	for (auto it = free_sectors.begin(); it != free_sectors.end(); ++it) {
+		if (it->second < count)
+			continue;
+
+		std::uint32_t sector = it->first;
+		std::uint32_t left = it->second - count;
+
+		free_sectors.erase(it);
+		if (left > 0)
+			free_sectors[sector + count] = left;
+
+		return sector;
+	}
+
+	std::uint32_t sector = end_sector;
+	std::size_t needed = (std::size_t)(sector + count) * REGION_SECTOR_SIZE;
+
+	if (needed > map_size) {
+		std::size_t new_size = std::max(needed, map_size + std::max(map_size / 4, (std::size_t)REGION_GROW_MIN));
+		new_size = (new_size + REGION_GROW_MIN - 1) / REGION_GROW_MIN * REGION_GROW_MIN;
+
+		std::size_t old_size = map_size;
+
+		if (!mapFile(new_size)) {
+			// Try to get the old map back, so reads keep working
+			mapFile(old_size);
+			return 0;
+		}
+	}
+
+	end_sector = sector + count;
+	return sector;
+}
+
+void VoxelRegionFile::release(std::uint32_t sector, std::uint32_t count) {
+	if (count == 0)
+		return;
+
+	// Merge with the holes on either side
+	auto next = free_sectors.lower_bound(sector);
+
+	if (next != free_sectors.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == sector) {
+			sector = prev->first;
+			count += prev->second;
+			free_sectors.erase(prev);
+		}
+	}
+
+	if (next != free_sectors.end() && sector + count == next->first) {
+		count += next->second;
+		free_sectors.erase(next);
+	}
+
+	// Space at the end just goes back to being the end
+	if (sector + count == end_sector)
+		end_sector = sector;
+	else
+		free_sectors[sector] = count;
+}
+
+void VoxelRegionFile::buildFreeList() {
+	std::uint32_t file_sectors = map_size / REGION_SECTOR_SIZE;
+
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> used;
+
+	for (Entry& entry : header()->entries) {
+		if (entry.sector == 0)
+			continue;
+
+		std::uint32_t count = sectorsFor(entry.length);
+
+		// Points into the header or off the end of the file, must be garbage
+		if (entry.sector < REGION_HEADER_SECTORS || entry.length == 0 || entry.sector + count > file_sectors || entry.sector + count < entry.sector) {
+			entry.sector = 0;
+			entry.length = 0;
+			continue;
+		}
+
+		used.push_back({ entry.sector, count });
+	}
+
+	std::sort(used.begin(), used.end());
+
+	free_sectors.clear();
+	end_sector = REGION_HEADER_SECTORS;
+
+	for (auto& run : used) {
+		if (run.first > end_sector)
+			free_sectors[end_sector] = run.first - end_sector;
+
+		end_sector = std::max(end_sector, run.first + run.second);
+	}
+}
+
+VoxelRegionStore::VoxelRegionStore(const std::string& dir) : dir(dir) {}
+
+VoxelRegionStore::~VoxelRegionStore() {
+	for (auto& it : regions)
+		delete it.second;
+}
+
+int VoxelRegionStore::readChunk(std::int32_t x, std::int32_t y, std::int32_t z, char* out, int out_size) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Shifting rounds down, so negative chunks land in the right region too
+	VoxelRegionFile* region = getRegion(x >> REGION_SHIFT, y >> REGION_SHIFT, z >> REGION_SHIFT, false);
+
+	if (region == nullptr)
+		return 0;
+
+	int len;
+	const char* data = region->read(x & (REGION_SIZE - 1), y & (REGION_SIZE - 1), z & (REGION_SIZE - 1), len);
+
+	if (data == nullptr || len > out_size)
+		return 0;
+
+	memcpy(out, data, len);
+	return len;
+}
+
+bool VoxelRegionStore::writeChunk(std::int32_t x, std::int32_t y, std::int32_t z, const char* data, int len) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	VoxelRegionFile* region = getRegion(x >> REGION_SHIFT, y >> REGION_SHIFT, z >> REGION_SHIFT, true);
+
+	if (region == nullptr)
+		return false;
+
+	return region->write(x & (REGION_SIZE - 1), y & (REGION_SIZE - 1), z & (REGION_SIZE - 1), data, len);
+}
+
+bool VoxelRegionStore::flush() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	bool ok = true;
+
+	for (auto& it : regions) {
+		if (it.second != nullptr && !it.second->flush())
+			ok = false;
+	}
+
+	return ok;
+}
+
+VoxelRegionFile* VoxelRegionStore::getRegion(std::int32_t rx, std::int32_t ry, std::int32_t rz, bool create) {
+	std::uint64_t key = packChunkKey(rx, ry, rz);
+
+	auto it = regions.find(key);
+	if (it != regions.end() && (it->second != nullptr || !create))
+		return it->second;
+
+	char name[64];
+	snprintf(name, sizeof(name), "/r.%i.%i.%i.vxr", rx, ry, rz);
+
+	VoxelRegionFile* region = VoxelRegionFile::open(dir + name, create);
+
+	regions[key] = region;
+	return region;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Region files hold REGION_SIZE^3 chunks each, so a save only has to touch the regions with dirty chunks in them,
+// and loading a chunk only reads that chunk. Layout:
+//  - Header: magic, version, then an entry per chunk with the sector its data starts at (0 = not saved) and its length in bytes.
+//  - Chunk data, compressed the same way chunks get sent (see vox_codec.h), each starting on a REGION_SECTOR_SIZE boundary.
+// Everything is little endian. The whole file is memory mapped, reads point straight into the map and
+// writes are a memcpy, the OS pages things in and out.
+// Writes never touch the last saved copy of a chunk. They go to fresh sectors, and the header only gets pointed at them by flush,
+// once they're on disk. A crash partway through a save leaves every chunk either old or new, never a mix.
+#define REGION_SHIFT 5
+#define REGION_SIZE (1 << REGION_SHIFT)
+#define REGION_CHUNKS (REGION_SIZE*REGION_SIZE*REGION_SIZE)
+
+#define REGION_SECTOR_SIZE 256
+
+class VoxelRegionFile {
+public:
+	~VoxelRegionFile();
+
+	// nullptr if the file can't be opened or isn't a region file. Only makes a new file if create is set.
+	static VoxelRegionFile* open(const std::string& path, bool create);
+
+	// Position is the chunk's position inside the region, 0 to REGION_SIZE-1. The data is only good until the next write.
+	// Sees writes that haven't been flushed yet.
+	const char* read(int x, int y, int z, int& len) const;
+
+	bool write(int x, int y, int z, const char* data, int len);
+
+	// Waits for written chunks to hit the disk, then points the header at them and frees the sectors they replaced.
+	// False if the OS couldn't write something, those chunks stay pending and get another go next time.
+	bool flush();
+
+private:
+	VoxelRegionFile() {}
+
+	struct Entry {
+		std::uint32_t sector;
+		std::uint32_t length;
+	};
+
+	struct Header {
+		std::uint32_t magic;
+		std::uint32_t version;
+		Entry entries[REGION_CHUNKS];
+	};
+
+	static std::uint32_t sectorsFor(std::uint32_t len) {
+		return (len + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE;
+	}
+
+	Header* header() const { return reinterpret_cast<Header*>(map); }
+
+	// Entry the chunk will have after the next flush
+	const Entry& currentEntry(int index) const;
+
+	bool mapFile(std::size_t new_size);
+	bool syncRange(std::size_t offset, std::size_t size);
+	void unmapFile();
+
+	// Finds room for a run of sectors, growing the file if there's no hole big enough
+	std::uint32_t allocate(std::uint32_t count);
+	void release(std::uint32_t sector, std::uint32_t count);
+
+	void buildFreeList();
+
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#else
+	int file = -1;
+#endif
+
+	char* map = nullptr;
+	std::size_t map_size = 0;
+
+	// First sector past the last used one
+	std::uint32_t end_sector = 0;
+
+	// Holes between used sectors, start -> count
+	std::map<std::uint32_t, std::uint32_t> free_sectors;
+
+	// Written since the last flush, entry index -> where the data went. The header still points at the old sectors,
+	// so those stay taken until then.
+	std::unordered_map<int, Entry> pending;
+};
+
+// All the region files in a save directory, opened as chunks in them get used.
+// Safe to use from several threads, everything goes through one lock.
+class VoxelRegionStore {
+public:
+	// The directory must already exist.
+	VoxelRegionStore(const std::string& dir);
+	~VoxelRegionStore();
+
+	const std::string& getDir() const { return dir; }
+
+	// Copies out compressed chunk data, returns the size. 0 if the chunk was never saved or doesn't fit in out_size.
+	int readChunk(std::int32_t x, std::int32_t y, std::int32_t z, char* out, int out_size);
+
+	bool writeChunk(std::int32_t x, std::int32_t y, std::int32_t z, const char* data, int len);
+
+	// See VoxelRegionFile::flush. Nothing written is safe from a crash until this returns true.
+	bool flush();
+
+private:
+	VoxelRegionFile* getRegion(std::int32_t rx, std::int32_t ry, std::int32_t rz, bool create);
+
+	std::string dir;
+
+	std::mutex mutex;
+
+	// Region position -> file, nullptr for regions we looked for and didn't find
+	std::unordered_map<std::uint64_t, VoxelRegionFile*> regions;
+};
@@ -0,0 +1,110 @@
+#include "vox_threadpool.h"
+
+VoxelThreadPool::VoxelThreadPool(int thread_count) {
+	if (thread_count <= 0) {
+		thread_count = std::thread::hardware_concurrency() - 1;
+		if (thread_count < 1)
+			thread_count = 1;
+	}
+
+	for (int i = 0; i < thread_count; i++) {
+		workers.emplace_back(&VoxelThreadPool::workerMain, this);
+	}
+}
+
+VoxelThreadPool::~VoxelThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(jobs_mutex);
+		stopping = true;
+	}
+	jobs_cv.notify_all();
+
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+void VoxelThreadPool::submit(std::function<void()> job) {
+	{
+		std::lock_guard<std::mutex> lock(jobs_mutex);
+		jobs.push_back(std::move(job));
+	}
+	jobs_cv.notify_one();
+}
+
+int VoxelThreadPool::getThreadCount() {
+	return workers.size();
+}
+
+void VoxelThreadPool::workerMain() {
+	while (true) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(jobs_mutex);
+			jobs_cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+			// Finish off whatever is queued before bailing, someone might be waiting on it
+			if (jobs.empty())
+				return;
+
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		job();
+	}
+}
+
+void VoxelJobGroup::run(VoxelThreadPool* pool, std::function<void()> job) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending++;
+	}
+
+	pool->submit([this, job]() {
+		job();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--pending == 0)
+			cv.notify_all();
+	});
+}
+
+void VoxelJobGroup::wait() {
+	std::unique_lock<std::mutex> lock(mutex);
+	cv.wait(lock, [this] { return pending == 0; });
+}
+
+int VoxelJobGroup::getPending() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return pending;
+}
+
+VoxelThreadPool* sharedThreadPool = nullptr;
+
+VoxelThreadPool* getThreadPool() {
+	if (sharedThreadPool == nullptr)
+		sharedThreadPool = new VoxelThreadPool();
+
+	return sharedThreadPool;
+}
+
+VoxelThreadPool* ioThreadPool = nullptr;
+
+VoxelThreadPool* getIOThreadPool() {
+	if (ioThreadPool == nullptr)
+		ioThreadPool = new VoxelThreadPool(1);
+
+	return ioThreadPool;
+}
+
+void shutdownThreadPool() {
+	if (sharedThreadPool != nullptr) {
+		delete sharedThreadPool;
+		sharedThreadPool = nullptr;
+	}
+
+	if (ioThreadPool != nullptr) {
+		delete ioThreadPool;
+		ioThreadPool = nullptr;
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Dead simple worker pool. Jobs are run in FIFO order by whichever worker grabs them first.
+// Jobs must NEVER touch the engine or lua, they run off the game thread!
+class VoxelThreadPool {
+public:
+	// 0 threads = one less than the number of cores, but always at least one
+	VoxelThreadPool(int thread_count = 0);
+	~VoxelThreadPool();
+
+	void submit(std::function<void()> job);
+
+	int getThreadCount();
+private:
+	void workerMain();
+
+	std::vector<std::thread> workers;
+
+	std::deque<std::function<void()>> jobs;
+	std::mutex jobs_mutex;
+	std::condition_variable jobs_cv;
+
+	bool stopping = false;
+};
+
+// Tracks a bunch of jobs so the owner can wait for all of them to finish,
+// ie. before freeing anything the jobs point at.
+class VoxelJobGroup {
+public:
+	void run(VoxelThreadPool* pool, std::function<void()> job);
+
+	void wait();
+	int getPending();
+private:
+	std::mutex mutex;
+	std::condition_variable cv;
+	int pending = 0;
+};
+
+// Shared pool, created on first use. Shut down on module unload.
+VoxelThreadPool* getThreadPool();
+
+// A single thread for saving and loading, created on first use. Those jobs are big and sit on disk, so they get
+// their own thread instead of holding up meshing, traces and generation queued behind them on the shared pool.
+VoxelThreadPool* getIOThreadPool();
+
+// Shuts down both of them.
+void shutdownThreadPool();
@@ -9,30 +9,38 @@
 #include <functional>
 #include <algorithm>
 #include <vector>
-#include <tuple>
+#include <chrono>
+#include <cstring>
+#include <atomic>
 
 #include "collisionutils.h"
 
-#include "fastlz.h"
-
-#include "vox_worldgen_basic.h"
+#include "vox_mesher.h"
+#include "vox_regionfile.h"
+#include "vox_persist.h"
 
 #include "vox_network.h"
 
 #include "GarrysMod/LuaHelpers.hpp"
 
-const int VOXEL_VERT_FMT = VERTEX_POSITION | VERTEX_NORMAL | VERTEX_FORMAT_VERTEX_SHADER | VERTEX_USERDATA_SIZE(4) | VERTEX_TEXCOORD_SIZE(0, 2) | VERTEX_TEXCOORD_SIZE(1, 2);
+// Compact, see emitQuadVertices in vox_mesher.h
+const int VOXEL_VERT_FMT = VERTEX_POSITION | VERTEX_COLOR | VERTEX_FORMAT_VERTEX_SHADER;
+
+// Don't let too many snapshots pile up if the workers are falling behind
+#define MESH_MAX_JOBS_IN_FLIGHT 64
 
-// TODO re-calibrate this for greedy meshing
-#define BUILD_MAX_VERTS (VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*4*2)
+// Chunks per thread pool job when generating a whole world at once
+#define GENERATE_BATCH_SIZE 8
 
-#define DIR_X_POS 1
-#define DIR_Y_POS 2
-#define DIR_Z_POS 3
+// Chunks per thread pool job when huge worlds load chunks that came into view, see submitLoads
+#define STREAM_LOAD_BATCH_SIZE 16
 
-#define DIR_X_NEG 4
-#define DIR_Y_NEG 5
-#define DIR_Z_NEG 6
+// Chunks per load job, and how many finished ones get put in the world each tick
+#define PERSIST_LOAD_BATCH_SIZE 64
+#define PERSIST_LOAD_BATCHES_PER_TICK 2
+
+// Huge worlds can't just send everything, so they get this if they don't set a viewRadius
+#define HUGE_DEFAULT_VIEW_RADIUS 8
 
 std::unordered_map<int,VoxelWorld*> indexedVoxelWorldRegistry;
 
@@ -88,9 +96,20 @@ void checkAllVoxelWorldsDeleted() {
 	indexedVoxelWorldRegistry.clear();
 }
 
-VoxelWorld::VoxelWorld(VoxelConfig& config) {
+VoxelWorld::VoxelWorld(VoxelConfig& config) : mesh_pool(VOXEL_VERT_FMT, MESH_MAX_QUADS) {
 	this->config = config;
 
+	if (this->config.huge && this->config.viewRadius <= 0)
+		this->config.viewRadius = HUGE_DEFAULT_VIEW_RADIUS;
+
+	// Bounded worlds know exactly which chunks they can have, so those get a flat array instead of hashing
+	if (!config.huge) {
+		chunks_map.setDenseBounds(
+			(config.dims_x + VOXEL_CHUNK_SIZE - 1) / VOXEL_CHUNK_SIZE,
+			(config.dims_y + VOXEL_CHUNK_SIZE - 1) / VOXEL_CHUNK_SIZE,
+			(config.dims_z + VOXEL_CHUNK_SIZE - 1) / VOXEL_CHUNK_SIZE);
+	}
+
 	if (config.atlasMaterial != nullptr)
 		config.atlasMaterial->IncrementReferenceCount();
 
@@ -98,29 +117,55 @@ VoxelWorld::VoxelWorld(VoxelConfig& config) {
 }
 
 VoxelWorld::~VoxelWorld() {
-	for (auto it : chunks_map) {
-		// Pretty sure chunk pointers should never be null but I guess it can't hurt to check
-		if (it.second != nullptr) {
-			delete it.second;
-		}
+	// Jobs point at our config, wait for them before anything goes away
+	mesh_jobs.wait();
+
+	// Same with saves and loads. Chunks are going away, so nothing gets finished up
+	persist_jobs.wait();
+
+#ifdef VOXELATE_SERVER
+	stream_load_jobs.wait();
+
+	for (auto batch : finished_loads)
+		delete batch;
+#endif
+
+	delete save_job;
+
+	if (load_job != nullptr) {
+		for (auto batch : load_job->ready)
+			delete batch;
+
+		delete load_job;
+	}
+
+	for (auto job : finished_mesh_jobs) {
+		delete job;
+	}
+	finished_mesh_jobs.clear();
+
+	for (VoxelChunk* chunk : chunks_map) {
+		delete chunk;
 	}
 
 	// Don't think this is needed but W/E
 	chunks_map.clear();
 
+	delete save_store;
+
 	if (config.atlasMaterial != nullptr)
 		config.atlasMaterial->DecrementReferenceCount();
 }
 
 VoxelChunk* VoxelWorld::initChunk(Coord x, Coord y, Coord z) {
-	auto iter = chunks_map.find({ x, y, z });
+	VoxelChunk* existing = chunks_map.find(x, y, z);
 
-	if (iter != chunks_map.end())
-		return iter->second;
+	if (existing != nullptr)
+		return existing;
 
 	VoxelChunk* chunk = new VoxelChunk(this, x, y, z);
 
-	chunks_map.insert({ { x, y, z }, chunk });
+	chunks_map.insert(x, y, z, chunk);
 
 	flagChunk({ x,y,z }, false);
 
@@ -136,27 +181,149 @@ VoxelChunk* VoxelWorld::initChunk(Coord x, Coord y, Coord z) {
 }
 
 VoxelChunk* VoxelWorld::getChunk(Coord x, Coord y, Coord z) {
-	auto iter = chunks_map.find({ x, y, z });
+	return chunks_map.find(x, y, z);
+}
 
-	if (iter == chunks_map.end())
-		return nullptr;
+bool VoxelWorld::unloadChunk(Coord x, Coord y, Coord z) {
+	VoxelChunk* chunk = chunks_map.erase(x, y, z);
+
+	if (chunk == nullptr)
+		return false;
+
+	delete chunk;
+
+	// Same neighbors as initChunk, they had faces hidden against us
+	flagChunk({ x - 1, y, z }, false);
+	flagChunk({ x, y - 1, z }, false);
+	flagChunk({ x, y, z - 1 }, false);
+
+	return true;
+}
+
+VoxelChunk* VoxelWorld::loadChunk(Coord x, Coord y, Coord z) {
+	VoxelChunk* chunk = chunks_map.find(x, y, z);
+
+	if (chunk != nullptr)
+		return chunk;
+
+	chunk = initChunk(x, y, z);
+
+	const char* data = nullptr;
+	int len = 0;
+
+	char buffer[CODEC_MAX_COMPRESSED_SIZE];
+
+	auto it = evicted_chunks.find(packChunkKey(x, y, z));
+	if (it != evicted_chunks.end()) {
+		data = it->second.data();
+		len = it->second.size();
+	}
+	else if (save_store != nullptr) {
+		len = save_store->readChunk(x, y, z, buffer, sizeof(buffer));
+		if (len > 0)
+			data = buffer;
+	}
+
+	if (data != nullptr) {
+		BlockData raw[VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
+
+		if (voxDecompress(data, len, raw)) {
+			chunk->setAll(raw);
+		}
+		else {
+			vox_print("VoxelWorld::loadChunk -> Decompression failed! [%i, %i, %i]", x, y, z);
+			chunk->generate();
+		}
+	}
+	else {
+		chunk->generate();
+	}
+
+	// Whatever came from the save or the generator can be loaded again, so it doesn't need saving until it changes.
+	// Evicted chunks move back out of memory though, they stay dirty so they get saved or evicted again.
+	if (it != evicted_chunks.end()) {
+		evicted_chunks.erase(it);
+		chunk->saved_version = chunk->getVersion() - 1;
+	}
+	else {
+		chunk->saved_version = chunk->getVersion();
+	}
+
+	chunk->last_used = ++use_clock;
+
+#ifdef VOXELATE_SERVER
+	// Peers were waiting on this one to load in the background, they can have it now
+	if (pending_loads.erase(packChunkKey(x, y, z)) != 0)
+		chunkArrived(chunk);
+#endif
+
+	return chunk;
+}
+
+// Once there's more than maxLoadedChunks, drops the chunks no peer has in view, least recently used first, until we're 1/8 under.
+// Chunks with changes get written to the save, or kept compressed in evicted_chunks if there isn't one. Untouched ones just get loaded again next time.
+void VoxelWorld::evictChunks() {
+	if (!config.huge || (int)chunks_map.size() <= config.maxLoadedChunks)
+		return;
+
+	// A save in flight might not have written what we'd drop yet, and a load would write over it. Wait for them.
+	if (save_job != nullptr || load_job != nullptr)
+		return;
 
-	return iter->second;
+	std::vector<VoxelChunk*> candidates;
+
+	for (VoxelChunk* chunk : chunks_map) {
+		if (chunk->viewers == 0)
+			candidates.push_back(chunk);
+	}
+
+	std::size_t target = config.maxLoadedChunks - config.maxLoadedChunks / 8;
+	std::size_t evict_count = MIN(chunks_map.size() - target, candidates.size());
+
+	std::nth_element(candidates.begin(), candidates.begin() + evict_count, candidates.end(), [](VoxelChunk* a, VoxelChunk* b) {
+		return a->last_used < b->last_used;
+	});
+
+	bool wrote = false;
+
+	for (std::size_t i = 0; i < evict_count; i++) {
+		VoxelChunk* chunk = candidates[i];
+
+		if (chunk->getVersion() != chunk->saved_version) {
+			const char* data;
+			int size = chunk->getCompressed(data);
+
+			// Keep it in memory if there's nowhere to save it, or saving didn't work
+			if (save_store == nullptr || !save_store->writeChunk(chunk->posX, chunk->posY, chunk->posZ, data, size))
+				evicted_chunks[packChunkKey(chunk->posX, chunk->posY, chunk->posZ)].assign(data, size);
+			else
+				wrote = true;
+		}
+
+		chunks_map.erase(chunk->posX, chunk->posY, chunk->posZ);
+		delete chunk;
+	}
+
+	// The save is the only copy of those now, don't leave them waiting for the next one to be flushed
+	if (wrote)
+		save_store->flush();
 }
 
 // Fills a buffer at out with COMPRESSED chunk data, returns size.
 
-const int CHUNK_BUFFER_SIZE = 9000;
+const int CHUNK_BUFFER_SIZE = CODEC_MAX_COMPRESSED_SIZE;
 
 const int VoxelWorld::getChunkData(Coord x, Coord y, Coord z,char* out) {
-	auto iter = chunks_map.find({ x, y, z });
+	VoxelChunk* chunk = chunks_map.find(x, y, z);
 
-	if (iter == chunks_map.end())
+	if (chunk == nullptr)
 		return 0;
 
-	const char* input = reinterpret_cast<const char*>(iter->second->voxel_data);
+	const char* data;
+	int size = chunk->getCompressed(data);
 
-	return fastlz_compress(input, VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE * 2, out);
+	memcpy(out, data, size);
+	return size;
 }
 
 bool VoxelWorld::setChunkData(Coord x, Coord y, Coord z, const char* data_compressed, int data_len) {
@@ -167,103 +334,238 @@ bool VoxelWorld::setChunkData(Coord x, Coord y, Coord z, const char* data_compre
 
 	VoxelChunk* chunk = initChunk(x, y, z);
 
-	auto res = fastlz_decompress(data_compressed, data_len, chunk->voxel_data, VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE * 2);
+	BlockData raw[VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
 
-	if (res == 0) {
-		vox_print("VoxelWorld::setChunkData -> FastLZ decompression failed! [%i, %i, %i]", x, y, z);
+	if (!voxDecompress(data_compressed, data_len, raw)) {
+		vox_print("VoxelWorld::setChunkData -> Decompression failed! [%i, %i, %i]", x, y, z);
 		return false;
 	}
 
+	chunk->setAll(raw);
+
 	return true;
 }
 
-// DON'T USE THIS
-bool VoxelWorld::loadFromString(std::string contents) {
-	if (contents.size() == 0) {
-		return 0;
+bool VoxelWorld::save(const std::string& dir) {
+	if (save_job != nullptr || load_job != nullptr)
+		return false;
+
+	// A different directory doesn't have any of our chunks, so everything goes in, not just what changed.
+	// On huge worlds that's only what's in memory, chunks sitting in the old directory stay there.
+	bool everything = save_everything || save_store == nullptr || save_store->getDir() != dir;
+
+	if (save_store == nullptr || save_store->getDir() != dir) {
+#ifdef VOXELATE_SERVER
+		// Chunks coming into view might still be reading from the old one
+		stream_load_jobs.wait();
+		updateLoads();
+#endif
+
+		delete save_store;
+		save_store = new VoxelRegionStore(dir);
 	}
 
-	bf_read reader;
-	reader.StartReading(contents.c_str(), contents.size());
+	save_everything = false;
 
-	auto magic = reader.ReadUBitLong(32);
-	if (magic != 0xB00B1351) { // boobies v1
-		// bad header
-		return false;
+	save_job = new VoxelSaveJob();
+	save_job->store = save_store;
+	save_job->codec = config.codec;
+
+	std::vector<VoxelSaveItem>& items = save_job->items;
+
+	for (VoxelChunk* chunk : chunks_map) {
+		if (!everything && chunk->getVersion() == chunk->saved_version)
+			continue;
+
+		items.emplace_back();
+		VoxelSaveItem& item = items.back();
+		item.x = chunk->posX;
+		item.y = chunk->posY;
+		item.z = chunk->posZ;
+
+		// Compressing is the slow part, only take it here if it's already done
+		const char* data;
+		int size = chunk->getCachedCompressed(data);
+
+		if (size > 0) {
+			item.compressed.assign(data, size);
+		}
+		else {
+			// The worker compresses a snapshot instead, edits from here on don't touch it
+			item.data = chunk->getDataRef();
+		}
+
+		chunk->saved_version = chunk->getVersion();
+	}
+
+	// Evicted before there was anywhere to put them. They stay in memory until the save is done, in case they get loaded again.
+	for (auto& it : evicted_chunks) {
+		items.emplace_back();
+		VoxelSaveItem& item = items.back();
+		unpackChunkKey(it.first, item.x, item.y, item.z);
+		item.compressed = it.second;
+		item.evicted = true;
 	}
 
-	auto totalChunks = reader.ReadUBitLong(32);
+	persist_kind = VPERSIST_SAVE;
+	persist_done = 0;
+	persist_total = items.size();
+	persist_finished = false;
+
+	VoxelSaveJob* job = save_job;
+	persist_jobs.run(getIOThreadPool(), [job]() {
+		runSaveJob(job);
+	});
+
+	return true;
+}
 
-	if (reader.IsOverflowed()) {
+bool VoxelWorld::load(const std::string& dir) {
+	if (save_job != nullptr || load_job != nullptr)
 		return false;
-	}
 
-	std::unordered_map<XYZCoordinate, std::tuple<size_t, char*>> toLoad;
+#ifdef VOXELATE_SERVER
+	// Chunks coming into view might still be reading from the old save. Put them in the world first, so they get loaded over too.
+	stream_load_jobs.wait();
+	updateLoads();
+#endif
+
+	delete save_store;
+	save_store = new VoxelRegionStore(dir);
 
-	for (unsigned int i = 0; i < totalChunks; i++) {
-		Coord chunkX = reader.ReadUBitLong(32);
-		Coord chunkY = reader.ReadUBitLong(32);
-		Coord chunkZ = reader.ReadUBitLong(32);
+	// Whatever got evicted belongs to the world we're replacing
+	evicted_chunks.clear();
+	save_everything = false;
 
-		auto dataSize = reader.ReadUBitLong(14);
+	load_job = new VoxelLoadJob();
+	load_job->store = save_store;
 
-		if (reader.IsOverflowed()) {
-			return false;
-		}
+	for (VoxelChunk* chunk : chunks_map)
+		load_job->positions.push_back({ chunk->posX, chunk->posY, chunk->posZ });
 
-		auto chunkData = new(std::nothrow) char[CHUNK_BUFFER_SIZE];
-		reader.ReadBytes(chunkData, dataSize);
+	persist_kind = VPERSIST_LOAD;
+	persist_done = 0;
+	persist_total = load_job->positions.size();
+	persist_finished = false;
 
-		if (reader.IsOverflowed()) {
-			return false;
-		}
+	VoxelLoadJob* job = load_job;
+	int count = job->positions.size();
 
-		toLoad[{chunkX, chunkY, chunkZ}] = std::make_tuple(dataSize, chunkData);
+	for (int first = 0; first < count; first += PERSIST_LOAD_BATCH_SIZE) {
+		int last = MIN(first + PERSIST_LOAD_BATCH_SIZE, count);
+
+		persist_jobs.run(getIOThreadPool(), [job, first, last]() {
+			runLoadBatch(job, first, last);
+		});
 	}
 
-	// if we're here, the chunk read was successful
+	return true;
+}
+
+// Game thread side of saves and loads: finishes up saves, and drops loaded chunks into the world a few batches at a time.
+void VoxelWorld::updatePersistence() {
+	if (save_job != nullptr) {
+		persist_done = save_job->done;
+
+		if (save_job->finished) {
+			for (VoxelSaveItem& item : save_job->items) {
+				if (item.evicted) {
+					// Unless it got loaded and evicted again while we were saving, it's on disk now
+					auto it = evicted_chunks.find(packChunkKey(item.x, item.y, item.z));
+					if (it != evicted_chunks.end() && it->second == item.compressed)
+						evicted_chunks.erase(it);
+				}
+			}
 
-	auto success = true;
+			// We already marked everything saved, so a failed save has to write everything next time
+			if (!save_job->ok) {
+				vox_print("VoxelWorld::save -> Couldn't write everything to %s!", save_store->getDir().c_str());
+				save_everything = true;
+			}
 
-	for (auto it : toLoad) {
-		if (!setChunkData(it.first[0], it.first[1], it.first[2], std::get<1>(it.second), std::get<0>(it.second))) {
-			// well we're fucked
+			persist_finished = true;
+			persist_ok = save_job->ok;
 
-			success = false;
-			break;
+			delete save_job;
+			save_job = nullptr;
 		}
 	}
 
-	for (auto it : toLoad) {
-		// delete[std::get<0>(it.second)] std::get<1>(it.second);
-		// TODO: ^ fucks up in linux builds
-	}
+	if (load_job != nullptr) {
+		for (int i = 0; i < PERSIST_LOAD_BATCHES_PER_TICK; i++) {
+			std::vector<VoxelLoadedChunk>* batch;
+			{
+				std::lock_guard<std::mutex> lock(load_job->ready_mutex);
+				if (load_job->ready.empty())
+					break;
+
+				batch = load_job->ready.front();
+				load_job->ready.pop_front();
+			}
 
-	toLoad.clear();
+			for (VoxelLoadedChunk& loaded : *batch) {
+				VoxelChunk* chunk = chunks_map.find(loaded.pos[0], loaded.pos[1], loaded.pos[2]);
 
-	return success;
-}
+				if (chunk == nullptr)
+					continue;
 
-// DON'T USE THIS EITHER
-std::tuple<char*,size_t> VoxelWorld::writeToString() {
-	auto chunksToWrite = chunks_map.size();
-	auto worldData = new(std::nothrow) char[CHUNK_BUFFER_SIZE * chunksToWrite + 32];
+				if (loaded.ok) {
+					chunk->setAll(loaded.raw);
+					load_job->loaded++;
+				}
+				else {
+					if (loaded.found)
+						vox_print("VoxelWorld::load -> Decompression failed! [%i, %i, %i]", chunk->posX, chunk->posY, chunk->posZ);
 
-	bf_write writer;
-	writer.StartWriting(worldData, CHUNK_BUFFER_SIZE * chunksToWrite + 32);
+					chunk->generate();
+				}
+
+				chunk->saved_version = chunk->getVersion();
+
+				flagChunkSides({ chunk->posX, chunk->posY, chunk->posZ }, true, true, true);
+			}
 
-	writer.WriteUBitLong(0xB00B1351, 32);
-	writer.WriteUBitLong(chunksToWrite, 32);
+			load_job->applied += batch->size();
+			delete batch;
+		}
+
+		persist_done = load_job->applied;
 
-	for (auto it : chunks_map) {
-		char buffer[CHUNK_BUFFER_SIZE];
-		int compressed_size = getChunkData(it.first[0], it.first[1], it.first[2], buffer);
+		if (load_job->applied == (int)load_job->positions.size()) {
+			// Workers are all done once everything's applied
+			persist_finished = true;
+			persist_ok = true;
+			persist_loaded = load_job->loaded;
+
+			delete load_job;
+			load_job = nullptr;
+		}
+	}
+}
 
-		writer.WriteUBitLong(compressed_size, 32);
-		writer.WriteBytes(buffer, compressed_size);
+void VoxelWorld::waitForPersistence() {
+	while (save_job != nullptr || load_job != nullptr) {
+		persist_jobs.wait();
+		updatePersistence();
 	}
+}
+
+bool VoxelWorld::getPersistStatus(VoxelPersistKind& kind, int& done, int& total, bool& finished, bool& ok, int& loaded) {
+	if (persist_kind == VPERSIST_NONE)
+		return false;
+
+	kind = persist_kind;
+	done = persist_done;
+	total = persist_total;
+	finished = persist_finished;
+	ok = persist_ok;
+	loaded = persist_loaded;
 
-	return std::make_tuple( worldData,writer.GetNumBytesWritten() );
+	// Finishing only gets reported once
+	if (finished)
+		persist_kind = VPERSIST_NONE;
+
+	return true;
 }
 
 // used to be called by some stupid shit
@@ -283,21 +585,54 @@ void VoxelWorld::initialize() {
 
 			//vox_print("---> %i %i %i",max_chunk_x,max_chunk_y,max_chunk_z);
 
+			// Set up every chunk here, then fill them in on the thread pool
+			std::vector<VoxelChunk*> new_chunks;
+			new_chunks.reserve((max_chunk_x + 1) * (max_chunk_y + 1) * (max_chunk_z + 1));
+
 			for (Coord x = 0; x <= max_chunk_x; x++) {
 				for (Coord y = 0; y <= max_chunk_y; y++) {
 					for (Coord z = 0; z <= max_chunk_z; z++) {
-						initChunk(x, y, z)->generate();
+						new_chunks.push_back(initChunk(x, y, z));
 					}
 				}
 			}
+
+			generateChunks(new_chunks);
 			// todo do we do mapgen here?
 		}
-		else {
-			vox_print("HUGE WORLDS NOT IMPLEMENTED YET!");
-		}
+		// Huge worlds start out empty, chunks get loaded as players come near them. See loadChunk.
 	}
 }
 
+// Runs generate on a bunch of chunks at once, spread over the thread pool. Doesn't return until they're all done.
+// Generating only touches the chunk itself, so nothing else can get in the way, but the chunks must already be in the map and flagged.
+void VoxelWorld::generateChunks(const std::vector<VoxelChunk*>& chunks) {
+	int count = chunks.size();
+
+	if (count <= GENERATE_BATCH_SIZE) {
+		for (VoxelChunk* chunk : chunks)
+			chunk->generate();
+		return;
+	}
+
+	VoxelJobGroup generate_jobs;
+
+	// Same as doTraceMany, the game thread takes the last batch instead of just waiting
+	int first = 0;
+	for (; first + GENERATE_BATCH_SIZE < count; first += GENERATE_BATCH_SIZE) {
+		int last = first + GENERATE_BATCH_SIZE;
+		generate_jobs.run(getThreadPool(), [&chunks, first, last]() {
+			for (int i = first; i < last; i++)
+				chunks[i]->generate();
+		});
+	}
+
+	for (int i = first; i < count; i++)
+		chunks[i]->generate();
+
+	generate_jobs.wait();
+}
+
 // Warning: We don't give a shit about this with huge worlds!
 Vector VoxelWorld::getExtents() {
 
@@ -323,8 +658,8 @@ std::vector<XYZCoordinate> VoxelWorld::getAllChunkPositions(Vector origin) {
 	// get them chunks
 	std::vector<XYZCoordinate> positions;
 
-	for (auto pair : chunks_map) {
-		positions.push_back( pair.first );
+	for (VoxelChunk* chunk : chunks_map) {
+		positions.push_back({ chunk->posX, chunk->posY, chunk->posZ });
 	}
 
 	// translate origin to a chunk coordinate
@@ -354,42 +689,53 @@ std::vector<XYZCoordinate> VoxelWorld::getAllChunkPositions(Vector origin) {
 	return positions;
 }
 
-void voxelworld_initialise_networking_static() {
-#ifdef VOXELATE_CLIENT
-	networking::channelListen(VOX_NETWORK_CHANNEL_CHUNKDATA_SINGLE, [&](int peerID, const char* data, size_t data_len) {
-		bf_read reader;
-		reader.StartReading(data, data_len);
-
-		int worldID = reader.ReadUBitLong(8);
-		//vox_print("hello? %i",worldID);
-
-		auto world = getIndexedVoxelWorld(worldID);
-
-		if (world == NULL) {
-			return;
-		}
-
-		XYZCoordinate pos = {
-			reader.ReadSBitLong(32),
-			reader.ReadSBitLong(32),
-			reader.ReadSBitLong(32)
-		};
+// LEB128 style varints: 7 bits a byte, low bits first, top bit set on every byte but the last.
+static void writeVarInt(bf_write& writer, uint32_t value) {
+	while (value >= 0x80) {
+		writer.WriteUBitLong((value & 0x7F) | 0x80, 8);
+		value >>= 7;
+	}
+	writer.WriteUBitLong(value, 8);
+}
 
-		//vox_print("Get chunk %i %i %i %i", worldID, pos[0], pos[1], pos[2]);
+// Same encoding, but always exactly byte_count bytes, so it can be written before we know the value and patched afterwards.
+// Readers can't tell the difference.
+static void writeVarIntPadded(bf_write& writer, uint32_t value, int byte_count) {
+	for (int i = 0; i < byte_count - 1; i++) {
+		writer.WriteUBitLong((value & 0x7F) | 0x80, 8);
+		value >>= 7;
+	}
+	writer.WriteUBitLong(value & 0x7F, 8);
+}
 
-		auto dataSize = reader.GetNumBytesLeft();
+static uint32_t readVarInt(bf_read& reader) {
+	uint32_t value = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		uint32_t b = reader.ReadUBitLong(8);
+		value |= (b & 0x7F) << shift;
+		if (!(b & 0x80))
+			break;
+	}
+	return value;
+}
 
-		char chunkData[CHUNK_BUFFER_SIZE];
-		reader.ReadBytes(chunkData, dataSize);
+// Small negative numbers to small unsigned ones: 0, -1, 1, -2... -> 0, 1, 2, 3...
+static uint32_t zigzag(int32_t value) {
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
 
-		world->setChunkData(pos[0], pos[1], pos[2], chunkData, dataSize);
-	});
+static int32_t unzigzag(uint32_t value) {
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
 
-	networking::channelListen(VOX_NETWORK_CHANNEL_CHUNKDATA_RADIUS, [&](int peerID, const char* data, size_t data_len) {
+void voxelworld_initialise_networking_static() {
+#ifdef VOXELATE_CLIENT
+	networking::channelListen(VOX_NETWORK_CHANNEL_CHUNKDATA_SET, [&](int peerID, const char* data, size_t data_len) {
 		bf_read reader;
 		reader.StartReading(data, data_len);
 
 		int worldID = reader.ReadUBitLong(8);
+		int type = reader.ReadUBitLong(8);
 
 		auto world = getIndexedVoxelWorld(worldID);
 
@@ -397,25 +743,36 @@ void voxelworld_initialise_networking_static() {
 			return;
 		}
 
-		Coord radius = reader.ReadUBitLong(8);
+		if (type == CHUNKSET_PACKET_EDITS) {
+			world->applyEdits(reader);
+			return;
+		}
 
-		XYZCoordinate origin = {
-			reader.ReadSBitLong(32),
-			reader.ReadSBitLong(32),
-			reader.ReadSBitLong(32)
-		};
+		uint32_t count = readVarInt(reader);
 
-		for (Coord x = 0; x < radius; x++) {
-			for (Coord y = 0; y < radius; y++) {
-				for (Coord z = 0; z < radius; z++) {
-					auto dataSize = reader.ReadUBitLong(16);
+		XYZCoordinate pos = { 0, 0, 0 };
 
-					char chunkData[CHUNK_BUFFER_SIZE];
-					reader.ReadBytes(chunkData, dataSize);
+		for (uint32_t i = 0; i < count; i++) {
+			pos[0] += unzigzag(readVarInt(reader));
+			pos[1] += unzigzag(readVarInt(reader));
+			pos[2] += unzigzag(readVarInt(reader));
 
-					world->setChunkData(origin[0] + x, origin[1] + y, origin[2] + z, chunkData, dataSize);
-				}
+			int dataSize = readVarInt(reader);
+
+			if (reader.IsOverflowed() || dataSize > reader.GetNumBytesLeft()) {
+				vox_print("Chunk set packet for world %i is truncated!", worldID);
+				return;
+			}
+
+			if (dataSize == 0) {
+				world->unloadChunk(pos[0], pos[1], pos[2]);
+				continue;
 			}
+
+			// Decompress straight out of the packet
+			world->setChunkData(pos[0], pos[1], pos[2], data + reader.GetNumBytesRead(), dataSize);
+
+			reader.SeekRelative(dataSize * 8);
 		}
 	});
 #endif
@@ -423,131 +780,792 @@ void voxelworld_initialise_networking_static() {
 
 #ifdef VOXELATE_SERVER
 
-bool VoxelWorld::sendChunk(int peerID, XYZCoordinate pos) {
-	static char msg[CHUNK_BUFFER_SIZE + 13];
+// Chunk data we try to fit in each chunk set packet, by default. ENet fragments it either way, this just keeps us from
+// making thousands of tiny packets, or single reliable packets big enough to stall everything behind them.
+#define CHUNKSET_PACKET_TARGET 16384
+
+// Chunk set packets, used for sending chunks to peers:
+//  world ID (8 bits)
+//  packet type (8 bits), CHUNKSET_PACKET_CHUNKS
+//  chunk count (varint, padded to 3 bytes so it can be filled in last)
+//  per chunk:
+//   x, y, z (zigzag varints, difference from the previous chunk, or from 0,0,0 for the first)
+//   compressed size (varint, padded to 2 bytes), 0 means the chunk went out of view and should be unloaded
+//   compressed data
+// Chunks get compressed straight into the packet, which is why the sizes ahead of them are padded.
+#define CHUNKSET_COUNT_BYTES 3
+#define CHUNKSET_SIZE_BYTES 2
+
+// Worst case for one entry: three 5 byte coordinate varints, the size, then a full CHUNK_BUFFER_SIZE to compress into
+#define CHUNKSET_ENTRY_MAX (3*5 + CHUNKSET_SIZE_BYTES + CHUNK_BUFFER_SIZE)
+
+// Builds chunk set packets in place, sending each one off once it reaches the target size.
+class ChunkSetSender {
+public:
+	ChunkSetSender(VoxelWorld* world, int peerID, int target_size) : world(world), peerID(peerID), target_size(target_size) {}
+
+	~ChunkSetSender() {
+		flush();
+	}
+
+	// False if the chunk doesn't exist
+	bool add(XYZCoordinate pos) {
+		if (packet == nullptr && !start())
+			return false;
 
-	bf_write writer;
-	writer.StartWriting(msg, CHUNK_BUFFER_SIZE + 13);
+		int entry_start = writer.GetNumBytesWritten();
 
-	writer.WriteUBitLong(worldID, 8);
+		writeVarInt(writer, zigzag(pos[0] - last_pos[0]));
+		writeVarInt(writer, zigzag(pos[1] - last_pos[1]));
+		writeVarInt(writer, zigzag(pos[2] - last_pos[2]));
 
-	writer.WriteSBitLong(pos[0], 32);
-	writer.WriteSBitLong(pos[1], 32);
-	writer.WriteSBitLong(pos[2], 32);
+		int size_start = writer.GetNumBytesWritten();
+		int compressed_size = world->getChunkData(pos[0], pos[1], pos[2], (char*)packet->data + size_start + CHUNKSET_SIZE_BYTES);
 
-	int compressed_size = getChunkData(pos[0], pos[1], pos[2], msg + writer.GetNumBytesWritten());
+		if (compressed_size == 0) {
+			writer.SeekToBit(entry_start * 8);
+			return false;
+		}
 
-	if (compressed_size == 0)
-		return false;
+		writeVarIntPadded(writer, compressed_size, CHUNKSET_SIZE_BYTES);
+		writer.SeekToBit((size_start + CHUNKSET_SIZE_BYTES + compressed_size) * 8);
 
-	return networking::channelSend(peerID, VOX_NETWORK_CHANNEL_CHUNKDATA_SINGLE, msg, writer.GetNumBytesWritten() + compressed_size );
-}
+		last_pos = pos;
+		count++;
 
+		if (writer.GetNumBytesWritten() >= target_size)
+			flush();
 
-bool VoxelWorld::sendChunksAround(int peerID, XYZCoordinate pos, Coord radius) {
-	auto maxSize = VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE * 2 * radius * + 24;
+		return true;
+	}
 
-	auto data = new(std::nothrow) uint8_t[maxSize];
+	// Tells the peer to drop a chunk
+	bool addUnload(XYZCoordinate pos) {
+		if (packet == nullptr && !start())
+			return false;
 
-	bf_write writer;
+		writeVarInt(writer, zigzag(pos[0] - last_pos[0]));
+		writeVarInt(writer, zigzag(pos[1] - last_pos[1]));
+		writeVarInt(writer, zigzag(pos[2] - last_pos[2]));
 
-	writer.StartWriting(data, maxSize);
+		writeVarIntPadded(writer, 0, CHUNKSET_SIZE_BYTES);
 
-	if (data == NULL) {
-		return false;
-	}
+		last_pos = pos;
+		count++;
+
+		if (writer.GetNumBytesWritten() >= target_size)
+			flush();
 
-	// write voxel ID
+		return true;
+	}
 
-	writer.WriteUBitLong(worldID, 8);
+	// Sends whatever is in the current packet
+	void flush() {
+		if (packet == nullptr)
+			return;
 
-	// write chunk num
+		if (count == 0) {
+			enet_packet_destroy(packet);
+			packet = nullptr;
+			return;
+		}
 
-	writer.WriteUBitLong(radius, 8);
+		int used_size = writer.GetNumBytesWritten();
 
-	// write origin
+		writer.SeekToBit(16);
+		writeVarIntPadded(writer, count, CHUNKSET_COUNT_BYTES);
 
-	writer.WriteSBitLong(pos[0], 32);
-	writer.WriteSBitLong(pos[1], 32);
-	writer.WriteSBitLong(pos[2], 32);
+		// Only ever shrinks, so enet just changes the length
+		enet_packet_resize(packet, used_size);
 
-	for (Coord x = 0; x < radius; x++) {
-		for (Coord y = 0; y < radius; y++) {
-			for (Coord z = 0; z < radius; z++) {
-				char chunkData[CHUNK_BUFFER_SIZE];
-				int len = getChunkData(pos[0] + x, pos[1] + y, pos[2] + z, chunkData);
+		networking::channelSendPacket(peerID, VOX_NETWORK_CHANNEL_CHUNKDATA_SET, packet);
+		packet = nullptr;
 
-				writer.WriteUBitLong(len, 16);
-				writer.WriteBytes(chunkData, len);
-			}
-		}
+		bytes_sent += used_size;
 	}
 
-	writer.WriteOneBit(0); // null terminate for good measure
+	int getBytesSent() { return bytes_sent; }
+private:
+	bool start() {
+		// Room for one more entry past the target, and bf_write wants a multiple of 4 bytes
+		size_t packet_size = (2 + CHUNKSET_COUNT_BYTES + target_size + CHUNKSET_ENTRY_MAX + 3) & ~3;
 
-	return networking::channelSend(peerID, VOX_NETWORK_CHANNEL_CHUNKDATA_RADIUS, data, writer.GetNumBytesWritten());
-}
-#endif
-/*
-void VoxelWorld::sortUpdatesByDistance(Vector* origin) {
-	// std::function<bool(VoxelChunk*,VoxelChunk*)>
+		packet = networking::channelCreatePacket(packet_size);
+		if (packet == nullptr)
+			return false;
 
-	if (origin != NULL) {
-		auto sorter = [&](VoxelChunk* c1, VoxelChunk* c2) {
-			auto c1pos = c1->getWorldCoords();
-			auto c2pos = c2->getWorldCoords();
+		writer.StartWriting(packet->data, packet_size);
 
-			if (c1pos[0] == c2pos[0]) {
-				if (c1pos[1] == c2pos[1]) {
-					auto Zdist1 = std::pow(c1pos[2] - origin->z, 2);
-					auto Zdist2 = std::pow(c2pos[2] - origin->z, 2);
+		writer.WriteUBitLong(world->worldID, 8);
+		writer.WriteUBitLong(CHUNKSET_PACKET_CHUNKS, 8);
+		writeVarIntPadded(writer, 0, CHUNKSET_COUNT_BYTES);
 
-					return Zdist1 < Zdist2;
-				}
-			}
+		count = 0;
+		last_pos = { 0, 0, 0 };
+		return true;
+	}
 
-			auto dist1 = std::pow(c1pos[0] - origin->x, 2) + std::pow(c1pos[1] - origin->y, 2);
-			auto dist2 = std::pow(c2pos[0] - origin->x, 2) + std::pow(c2pos[1] - origin->y, 2);
+	VoxelWorld* world;
+	int peerID;
+	int target_size;
 
-			return dist1 < dist2;
-		};
+	ENetPacket* packet = nullptr;
+	bf_write writer;
+	uint32_t count = 0;
+	XYZCoordinate last_pos = { 0, 0, 0 };
 
-		vox_print("no sorting allowed.");
-		//std::sort(chunks_flagged_for_update.begin(), chunks_flagged_for_update.end(), sorter);
-	}
+	int bytes_sent = 0;
+};
+
+bool VoxelWorld::sendChunk(int peerID, XYZCoordinate pos) {
+	ChunkSetSender sender(this, peerID, CHUNKSET_PACKET_TARGET);
+	return sender.add(pos);
 }
-*/
 
-// Updates up to n chunks
-// Logic probably okay for huge worlds, although we may have to double check that the chunk still exists,
-// or clean out chunks_flagged_for_update when we unload chunks
-// TODO: convert Vector to AdvancedVector
-void VoxelWorld::doUpdates(int count, CBaseEntity* ent) {
-	// On the server, we -NEED- the entity. Not so important on the client
-	if (!IS_SERVERSIDE || (ent != nullptr && config.buildPhysicsMesh)) {
-		for (int i = 0; i < count && !dirty_chunk_queue.empty(); i++) {
-			XYZCoordinate pos = dirty_chunk_queue.front();
-			dirty_chunk_queue.pop_front();
-			dirty_chunk_set.erase(pos);
+// Sends every chunk in the cube from pos - radius to pos + radius, split into packets of about packet_size bytes.
+bool VoxelWorld::sendChunksAround(int peerID, XYZCoordinate pos, Coord radius, int packet_size) {
+	if (radius < 0)
+		return false;
 
-			VoxelChunk* chunk = getChunk(pos[0], pos[1], pos[2]);
+	if (packet_size <= 0)
+		packet_size = CHUNKSET_PACKET_TARGET;
 
-			if (chunk != nullptr) {
-				chunk->build(ent);
+	ChunkSetSender sender(this, peerID, packet_size);
+
+	bool sent_any = false;
+
+	// x innermost, so consecutive chunks are mostly one apart and their coordinates take a byte each
+	for (Coord z = pos[2] - radius; z <= pos[2] + radius; z++) {
+		for (Coord y = pos[1] - radius; y <= pos[1] + radius; y++) {
+			for (Coord x = pos[0] - radius; x <= pos[0] + radius; x++) {
+				if (getChunk(x, y, z) != nullptr)
+					sent_any = sender.add({ x, y, z }) || sent_any;
 			}
 		}
 	}
+
+	return sent_any;
 }
 
-// Function for line traces. Re-scales vectors and moves the start to the beggining of the voxel entity,
-// Then calls fast trace function
-VoxelTraceRes VoxelWorld::doTrace(Vector startPos, Vector delta) {
-	Vector voxel_extents = getExtents();
+XYZCoordinate VoxelWorld::getOriginChunk(Vector origin) {
+	origin /= (VOXEL_CHUNK_SIZE * config.scale);
 
-	if (startPos.WithinAABox(Vector(0,0,0), voxel_extents)) {
-		return iTrace(startPos/config.scale , delta/config.scale, Vector(0,0,0)) * config.scale;
-	}
-	else {
+	return { (Coord)floor(origin.x), (Coord)floor(origin.y), (Coord)floor(origin.z) };
+}
+
+static std::int64_t chunkDistanceSqr(const XYZCoordinate& a, const XYZCoordinate& b) {
+	std::int64_t dx = a[0] - b[0];
+	std::int64_t dy = a[1] - b[1];
+	std::int64_t dz = a[2] - b[2];
+
+	return dx*dx + dy*dy + dz*dz;
+}
+
+void VoxelWorld::streamStart(int peerID, Vector origin) {
+	PeerView& view = views[peerID];
+	clearView(view);
+
+	view.center = getOriginChunk(origin);
+
+	std::vector<XYZCoordinate> positions;
+
+	if (config.viewRadius > 0) {
+		Coord radius = config.viewRadius;
+		std::int64_t radius_sqr = (std::int64_t)radius*radius;
+
+		const XYZCoordinate& center = view.center;
+
+		for (Coord z = center[2] - radius; z <= center[2] + radius; z++) {
+			for (Coord y = center[1] - radius; y <= center[1] + radius; y++) {
+				for (Coord x = center[0] - radius; x <= center[0] + radius; x++) {
+					XYZCoordinate pos = { x, y, z };
+
+					if (chunkDistanceSqr(pos, center) > radius_sqr)
+						continue;
+
+					if (config.huge) {
+						VoxelChunk* chunk = requestLoad(pos);
+						view.chunks[pos] = false;
+
+						if (chunk == nullptr) {
+							view.loading++;
+							continue;
+						}
+
+						chunk->viewers++;
+						positions.push_back(pos);
+						continue;
+					}
+
+					VoxelChunk* chunk = getChunk(x, y, z);
+					if (chunk == nullptr)
+						continue;
+
+					chunk->viewers++;
+					view.chunks[pos] = false;
+					positions.push_back(pos);
+				}
+			}
+		}
+
+		submitLoads(center);
+	}
+	else {
+		positions.reserve(chunks_map.size());
+
+		for (VoxelChunk* chunk : chunks_map) {
+			XYZCoordinate pos = { chunk->posX, chunk->posY, chunk->posZ };
+
+			chunk->viewers++;
+			view.chunks[pos] = false;
+			positions.push_back(pos);
+		}
+	}
+
+	view.queue.reset(positions, view.center);
+}
+
+// Huge worlds: pos just came into someone's view. Returns the chunk if it's loaded. If it isn't, it gets loaded on the thread pool
+// by the next submitLoads, and updateLoads hands it to everyone who can see it once it's ready.
+VoxelChunk* VoxelWorld::requestLoad(const XYZCoordinate& pos) {
+	VoxelChunk* chunk = getChunk(pos[0], pos[1], pos[2]);
+	if (chunk != nullptr)
+		return chunk;
+
+	ChunkKey key = packChunkKey(pos[0], pos[1], pos[2]);
+
+	// Already in memory, only needs decompressing
+	if (evicted_chunks.count(key) != 0)
+		return loadChunk(pos[0], pos[1], pos[2]);
+
+	if (pending_loads.count(key) == 0) {
+		pending_loads[key] = ++last_load_ticket;
+		load_requests.push_back(pos);
+	}
+
+	return nullptr;
+}
+
+// Hands everything requestLoad asked for to the thread pool, nearest to center first.
+void VoxelWorld::submitLoads(const XYZCoordinate& center) {
+	if (load_requests.empty())
+		return;
+
+	std::sort(load_requests.begin(), load_requests.end(), [&center](const XYZCoordinate& a, const XYZCoordinate& b) {
+		return chunkDistanceSqr(a, center) < chunkDistanceSqr(b, center);
+	});
+
+	VoxelRegionStore* store = save_store;
+	VoxelGenerator generator = config.generator;
+
+	int count = load_requests.size();
+
+	for (int first = 0; first < count; first += STREAM_LOAD_BATCH_SIZE) {
+		int last = MIN(first + STREAM_LOAD_BATCH_SIZE, count);
+
+		std::vector<VoxelStreamLoad>* batch = new std::vector<VoxelStreamLoad>(last - first);
+
+		for (int i = first; i < last; i++) {
+			const XYZCoordinate& pos = load_requests[i];
+
+			VoxelStreamLoad& load = (*batch)[i - first];
+			load.pos = pos;
+			load.ticket = pending_loads[packChunkKey(pos[0], pos[1], pos[2])];
+		}
+
+		stream_load_jobs.run(getThreadPool(), [this, batch, store, generator]() {
+			runStreamLoadBatch(*batch, store, generator);
+
+			std::lock_guard<std::mutex> lock(finished_loads_mutex);
+			finished_loads.push_back(batch);
+		});
+	}
+
+	load_requests.clear();
+}
+
+// Puts whatever the thread pool finished loading in the world.
+void VoxelWorld::updateLoads() {
+	std::deque<std::vector<VoxelStreamLoad>*> batches;
+	{
+		std::lock_guard<std::mutex> lock(finished_loads_mutex);
+		batches.swap(finished_loads);
+	}
+
+	for (auto batch : batches) {
+		for (VoxelStreamLoad& load : *batch) {
+			// loadChunk already got to it, and it might have been changed or evicted since
+			auto it = pending_loads.find(packChunkKey(load.pos[0], load.pos[1], load.pos[2]));
+			if (it == pending_loads.end() || it->second != load.ticket)
+				continue;
+
+			pending_loads.erase(it);
+
+			if (load.corrupt)
+				vox_print("VoxelWorld::loadChunk -> Decompression failed! [%i, %i, %i]", load.pos[0], load.pos[1], load.pos[2]);
+
+			VoxelChunk* chunk = getChunk(load.pos[0], load.pos[1], load.pos[2]);
+
+			if (chunk == nullptr) {
+				chunk = initChunk(load.pos[0], load.pos[1], load.pos[2]);
+				chunk->setAll(load.raw);
+
+				// Same as loadChunk, it can be loaded again so it doesn't need saving until it changes
+				chunk->saved_version = chunk->getVersion();
+				chunk->last_used = ++use_clock;
+			}
+
+			chunkArrived(chunk);
+		}
+
+		delete batch;
+	}
+}
+
+// A chunk peers were waiting on got loaded. Everyone who can see it counts as a viewer now, and gets it sent.
+void VoxelWorld::chunkArrived(VoxelChunk* chunk) {
+	XYZCoordinate pos = { chunk->posX, chunk->posY, chunk->posZ };
+
+	for (auto& entry : views) {
+		PeerView& view = entry.second;
+
+		if (view.chunks.count(pos) == 0)
+			continue;
+
+		chunk->viewers++;
+		view.loading--;
+		view.queue.push(pos);
+	}
+}
+
+// Called when the peer moves into another chunk. Chunks come into view at viewRadius, but don't leave until they're past
+// viewRadius + viewHysteresis, so walking back and forth over a chunk border doesn't keep resending the same chunks.
+void VoxelWorld::updateView(PeerView& view, ChunkSetSender& sender) {
+	Coord radius = config.viewRadius;
+	Coord keep_radius = radius + MAX(config.viewHysteresis, 0);
+
+	std::int64_t radius_sqr = (std::int64_t)radius*radius;
+	std::int64_t keep_radius_sqr = (std::int64_t)keep_radius*keep_radius;
+
+	bool dropped = false;
+
+	for (auto it = view.chunks.begin(); it != view.chunks.end();) {
+		const XYZCoordinate& pos = it->first;
+
+		if (chunkDistanceSqr(pos, view.center) > keep_radius_sqr) {
+			if (it->second)
+				sender.addUnload(pos);
+
+			VoxelChunk* chunk = getChunk(pos[0], pos[1], pos[2]);
+			if (chunk != nullptr) {
+				chunk->viewers--;
+				chunk->last_used = ++use_clock;
+			}
+			else if (config.huge) {
+				// Still loading, it goes in the world like anything else once it's done
+				view.loading--;
+			}
+
+			it = view.chunks.erase(it);
+			dropped = true;
+		}
+		else {
+			++it;
+		}
+	}
+
+	if (dropped) {
+		view.queue.filter([&view](const XYZCoordinate& pos) {
+			return view.chunks.count(pos) != 0;
+		});
+	}
+
+	const XYZCoordinate& center = view.center;
+
+	for (Coord z = center[2] - radius; z <= center[2] + radius; z++) {
+		for (Coord y = center[1] - radius; y <= center[1] + radius; y++) {
+			for (Coord x = center[0] - radius; x <= center[0] + radius; x++) {
+				XYZCoordinate pos = { x, y, z };
+
+				if (chunkDistanceSqr(pos, center) > radius_sqr || view.chunks.count(pos) != 0)
+					continue;
+
+				if (config.huge) {
+					VoxelChunk* chunk = requestLoad(pos);
+					view.chunks[pos] = false;
+
+					if (chunk == nullptr) {
+						view.loading++;
+						continue;
+					}
+
+					chunk->viewers++;
+					view.queue.push(pos);
+					continue;
+				}
+
+				VoxelChunk* chunk = getChunk(x, y, z);
+				if (chunk == nullptr)
+					continue;
+
+				chunk->viewers++;
+				view.chunks[pos] = false;
+				view.queue.push(pos);
+			}
+		}
+	}
+
+	submitLoads(center);
+}
+
+void VoxelWorld::clearView(PeerView& view) {
+	for (auto& entry : view.chunks) {
+		const XYZCoordinate& pos = entry.first;
+
+		VoxelChunk* chunk = getChunk(pos[0], pos[1], pos[2]);
+		if (chunk != nullptr) {
+			chunk->viewers--;
+			chunk->last_used = ++use_clock;
+		}
+	}
+
+	view.chunks.clear();
+	view.loading = 0;
+}
+
+// Sends chunk set packets until the byte budget is used up.
+int VoxelWorld::streamUpdate(int peerID, Vector origin, int byte_budget) {
+	if (config.huge)
+		updateLoads();
+
+	auto it = views.find(peerID);
+	if (it == views.end())
+		return 0;
+
+	PeerView& view = it->second;
+
+	ChunkSetSender sender(this, peerID, CHUNKSET_PACKET_TARGET);
+
+	XYZCoordinate center = getOriginChunk(origin);
+	if (center != view.center) {
+		view.center = center;
+		view.queue.setOrigin(center);
+
+		if (config.viewRadius > 0)
+			updateView(view, sender);
+	}
+
+	XYZCoordinate pos;
+	while (sender.getBytesSent() < byte_budget && view.queue.pop(pos)) {
+		auto entry = view.chunks.find(pos);
+
+		if (entry == view.chunks.end() || entry->second)
+			continue;
+
+		entry->second = true;
+		sender.add(pos);
+	}
+
+	sender.flush();
+
+	return view.queue.remaining() + view.loading;
+}
+
+void VoxelWorld::streamStop(int peerID) {
+	auto it = views.find(peerID);
+	if (it == views.end())
+		return;
+
+	clearView(it->second);
+	views.erase(it);
+}
+
+// Edit packets, on the same channel as chunk sets so they can't get ahead of the chunks they're for:
+//  world ID (8 bits)
+//  packet type (8 bits), CHUNKSET_PACKET_EDITS
+//  chunk x, y, z (zigzag varints)
+//  run count (varint, padded to 2 bytes so it can be filled in last)
+//  per run of changed voxels that were all set to the same thing, in voxel index order:
+//   voxels skipped since the end of the last run (varint)
+//   run length (varint)
+//   block data (16 bits)
+#define EDIT_COUNT_BYTES 2
+
+// Worst case is every voxel its own run, 6 bytes each
+#define EDIT_PACKET_MAX ((2 + 3*5 + EDIT_COUNT_BYTES + VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*6 + 3) & ~3)
+
+bool VoxelWorld::flushEdits() {
+	edit_packets.clear();
+
+	if (edit_journal.empty())
+		return false;
+
+	const int voxel_count = VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE;
+
+	edit_buffer.resize(EDIT_PACKET_MAX / 4);
+	char* buffer = reinterpret_cast<char*>(edit_buffer.data());
+
+	for (auto& entry : edit_journal) {
+		const XYZCoordinate& pos = entry.first;
+		const ChunkEdits& edits = entry.second;
+
+		bf_write writer;
+		writer.StartWriting(buffer, EDIT_PACKET_MAX);
+
+		writer.WriteUBitLong(worldID, 8);
+		writer.WriteUBitLong(CHUNKSET_PACKET_EDITS, 8);
+
+		writeVarInt(writer, zigzag(pos[0]));
+		writeVarInt(writer, zigzag(pos[1]));
+		writeVarInt(writer, zigzag(pos[2]));
+
+		int count_start = writer.GetNumBytesWritten();
+		writeVarIntPadded(writer, 0, EDIT_COUNT_BYTES);
+
+		uint32_t runs = 0;
+		int last_end = 0;
+
+		for (int i = 0; i < voxel_count;) {
+			if (!edits.changed[i]) {
+				i++;
+				continue;
+			}
+
+			int start = i;
+			BlockData d = edits.values[i];
+
+			while (i < voxel_count && edits.changed[i] && edits.values[i] == d)
+				i++;
+
+			writeVarInt(writer, start - last_end);
+			writeVarInt(writer, i - start);
+			writer.WriteUBitLong(d, 16);
+
+			last_end = i;
+			runs++;
+		}
+
+		int size = writer.GetNumBytesWritten();
+
+		writer.SeekToBit(count_start * 8);
+		writeVarIntPadded(writer, runs, EDIT_COUNT_BYTES);
+
+		edit_packets.emplace_back(pos, std::string(buffer, size));
+	}
+
+	edit_journal.clear();
+
+	return true;
+}
+
+void VoxelWorld::sendEdits(int peerID) {
+	auto it = views.find(peerID);
+	if (it == views.end())
+		return;
+
+	const PeerView& view = it->second;
+
+	for (auto& packet : edit_packets) {
+		// Chunks that haven't been sent yet will have the edits in them when they are
+		auto entry = view.chunks.find(packet.first);
+		if (entry == view.chunks.end() || !entry->second)
+			continue;
+
+		networking::channelSend(peerID, VOX_NETWORK_CHANNEL_CHUNKDATA_SET, &packet.second[0], packet.second.size());
+	}
+}
+#endif
+
+#ifdef VOXELATE_CLIENT
+bool VoxelWorld::applyEdits(bf_read& reader) {
+	const uint32_t voxel_count = VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE;
+
+	XYZCoordinate pos;
+	pos[0] = unzigzag(readVarInt(reader));
+	pos[1] = unzigzag(readVarInt(reader));
+	pos[2] = unzigzag(readVarInt(reader));
+
+	uint32_t runs = readVarInt(reader);
+
+	// Chunks we haven't been sent yet will have these edits in them when they get here
+	VoxelChunk* chunk = getChunk(pos[0], pos[1], pos[2]);
+	if (chunk == nullptr)
+		return false;
+
+	BlockData raw[VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
+	chunk->getData().unpack(raw);
+
+	bool touched_low_x = false;
+	bool touched_low_y = false;
+	bool touched_low_z = false;
+
+	uint32_t i = 0;
+	for (uint32_t r = 0; r < runs; r++) {
+		uint32_t skip = readVarInt(reader);
+		uint32_t length = readVarInt(reader);
+		BlockData d = reader.ReadUBitLong(16);
+
+		if (reader.IsOverflowed() || skip > voxel_count - i || length > voxel_count - i - skip) {
+			vox_print("Edit packet for world %i is corrupt!", worldID);
+			return false;
+		}
+
+		i += skip;
+
+		for (uint32_t end = i + length; i < end; i++) {
+			raw[i] = d;
+
+			touched_low_x |= i % VOXEL_CHUNK_SIZE == 0;
+			touched_low_y |= (i / VOXEL_CHUNK_SIZE) % VOXEL_CHUNK_SIZE == 0;
+			touched_low_z |= i < VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE;
+		}
+	}
+
+	chunk->setAll(raw);
+	flagChunkSides(pos, touched_low_x, touched_low_y, touched_low_z);
+
+	return true;
+}
+#endif
+/*
+void VoxelWorld::sortUpdatesByDistance(Vector* origin) {
+	// std::function<bool(VoxelChunk*,VoxelChunk*)>
+
+	if (origin != NULL) {
+		auto sorter = [&](VoxelChunk* c1, VoxelChunk* c2) {
+			auto c1pos = c1->getWorldCoords();
+			auto c2pos = c2->getWorldCoords();
+
+			if (c1pos[0] == c2pos[0]) {
+				if (c1pos[1] == c2pos[1]) {
+					auto Zdist1 = std::pow(c1pos[2] - origin->z, 2);
+					auto Zdist2 = std::pow(c2pos[2] - origin->z, 2);
+
+					return Zdist1 < Zdist2;
+				}
+			}
+
+			auto dist1 = std::pow(c1pos[0] - origin->x, 2) + std::pow(c1pos[1] - origin->y, 2);
+			auto dist2 = std::pow(c2pos[0] - origin->x, 2) + std::pow(c2pos[1] - origin->y, 2);
+
+			return dist1 < dist2;
+		};
+
+		vox_print("no sorting allowed.");
+		//std::sort(chunks_flagged_for_update.begin(), chunks_flagged_for_update.end(), sorter);
+	}
+}
+*/
+
+// Hands dirty chunks off to the mesh workers, then uploads finished meshes until we run out of time.
+// time_budget is in milliseconds. We always upload at least one mesh if one is ready, so we can't stall forever.
+// Logic probably okay for huge worlds, although we may have to double check that the chunk still exists,
+// or clean out chunks_flagged_for_update when we unload chunks
+// TODO: convert Vector to AdvancedVector
+void VoxelWorld::doUpdates(double time_budget, CBaseEntity* ent) {
+	updatePersistence();
+
+	if (config.huge && IS_SERVERSIDE)
+		evictChunks();
+
+	// On the server, we -NEED- the entity. Not so important on the client
+	if (IS_SERVERSIDE && (ent == nullptr || !config.buildPhysicsMesh))
+		return;
+
+	auto start_time = std::chrono::steady_clock::now();
+
+	while (mesh_jobs_in_flight < MESH_MAX_JOBS_IN_FLIGHT && !dirty_chunk_queue.empty()) {
+		XYZCoordinate pos = dirty_chunk_queue.front();
+		dirty_chunk_queue.pop_front();
+		dirty_chunk_set.erase(pos);
+
+		VoxelChunk* chunk = getChunk(pos[0], pos[1], pos[2]);
+
+		if (chunk == nullptr)
+			continue;
+
+		VoxelMeshJob* job = new VoxelMeshJob();
+		job->pos = pos;
+		job->generation = ++chunk->mesh_generation;
+		chunk->snapshotForMeshing(job->input, job->snapshot);
+
+		mesh_jobs_in_flight++;
+
+		mesh_jobs.run(getThreadPool(), [this, job]() {
+			unpackMeshInput(job->snapshot, job->input);
+
+			// Let go right away, so edits to these chunks don't have to copy them while we mesh
+			job->snapshot = VoxelChunkSnapshot();
+
+			buildChunkMesh(job->input, job->quads);
+
+			std::lock_guard<std::mutex> lock(finished_mesh_jobs_mutex);
+			finished_mesh_jobs.push_back(job);
+		});
+	}
+
+	while (true) {
+		VoxelMeshJob* job;
+		{
+			std::lock_guard<std::mutex> lock(finished_mesh_jobs_mutex);
+			if (finished_mesh_jobs.empty())
+				break;
+
+			job = finished_mesh_jobs.front();
+			finished_mesh_jobs.pop_front();
+		}
+
+		mesh_jobs_in_flight--;
+
+		VoxelChunk* chunk = getChunk(job->pos[0], job->pos[1], job->pos[2]);
+
+		// If the chunk got re-flagged while this job was running, a newer job is on the way
+		bool uploaded = chunk != nullptr && chunk->mesh_generation == job->generation;
+		if (uploaded) {
+			chunk->uploadMesh(job->quads, ent);
+		}
+
+		delete job;
+
+		if (uploaded) {
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start_time;
+			if (elapsed.count() >= time_budget)
+				break;
+		}
+	}
+}
+
+VoxelTraceRes VoxelWorld::doTrace(Vector startPos, Vector delta) {
+	VoxelTraceRes res = clipTrace(startPos, delta);
+
+	if (res.bailed)
+		vox_print("[bail] %f %f %f :: %f %f %f", startPos.x, startPos.y, startPos.z, delta.x, delta.y, delta.z);
+
+	return res;
+}
+
+VoxelTraceRes VoxelWorld::doTraceHull(Vector startPos, Vector delta, Vector extents) {
+	VoxelTraceRes res = clipTraceHull(startPos, delta, extents);
+
+	if (res.bailed)
+		vox_print("[bail-hull] %f %f %f :: %f %f %f", startPos.x, startPos.y, startPos.z, delta.x, delta.y, delta.z);
+
+	return res;
+}
+
+// Function for line traces. Re-scales vectors and moves the start to the beggining of the voxel entity,
+// Then calls fast trace function
+VoxelTraceRes VoxelWorld::clipTrace(Vector startPos, Vector delta) {
+	// No box to clip to, missing chunks are just empty space
+	if (config.huge)
+		return iTrace(startPos / config.scale, delta / config.scale, Vector(0, 0, 0)) * config.scale;
+
+	Vector voxel_extents = getExtents();
+
+	if (startPos.WithinAABox(Vector(0,0,0), voxel_extents)) {
+		return iTrace(startPos/config.scale , delta/config.scale, Vector(0,0,0)) * config.scale;
+	}
+	else {
 		Ray_t ray;
 		ray.Init(startPos,startPos+delta);
 		CBaseTrace tr;
@@ -562,7 +1580,10 @@ VoxelTraceRes VoxelWorld::doTrace(Vector startPos, Vector delta) {
 
 // Same as above for hull traces.
 // TODO deal with assumption mentioned below...?
-VoxelTraceRes VoxelWorld::doTraceHull(Vector startPos, Vector delta, Vector extents) {
+VoxelTraceRes VoxelWorld::clipTraceHull(Vector startPos, Vector delta, Vector extents) {
+	if (config.huge)
+		return iTraceHull(startPos / config.scale, delta / config.scale, extents / config.scale, Vector(0, 0, 0)) * config.scale;
+
 	Vector voxel_extents = getExtents();
 
 	//Calculate our bounds based on the offsets used by the player hull. This will not work for everything, but will preserve player movement.
@@ -586,13 +1607,81 @@ VoxelTraceRes VoxelWorld::doTraceHull(Vector startPos, Vector delta, Vector exte
 	}
 }
 
+// Traces per thread pool job in doTraceMany. Small batches aren't worth the trip through the pool.
+#define TRACE_BATCH_SIZE 64
+
+void VoxelWorld::doTraceMany(const unsigned char* in, unsigned char* out, int count, bool hull, Vector extents, bool parallel) {
+	// Workers can't print, bails get counted and reported once everything's done
+	std::atomic<int> bails(0);
+
+	auto run_traces = [this, in, out, hull, extents, &bails](int first, int last) {
+		for (int i = first; i < last; i++) {
+			float args[6];
+			memcpy(args, in + i * sizeof(args), sizeof(args));
+
+			Vector start(args[0], args[1], args[2]);
+			Vector delta(args[3], args[4], args[5]);
+
+			VoxelTraceRes r = hull ? clipTraceHull(start, delta, extents) : clipTrace(start, delta);
+			if (r.fraction == -1)
+				r.hitPos = Vector(0, 0, 0);
+
+			if (r.bailed)
+				bails++;
+
+			float res[7] = {
+				(float)r.fraction,
+				r.hitPos.x, r.hitPos.y, r.hitPos.z,
+				r.hitNormal.x, r.hitNormal.y, r.hitNormal.z
+			};
+			memcpy(out + i * sizeof(res), res, sizeof(res));
+		}
+	};
+
+	if (!parallel || count <= TRACE_BATCH_SIZE) {
+		run_traces(0, count);
+	}
+	else {
+		// Traces only read the world, and the game thread is stuck in here until they're done, so nothing can change under them.
+		// The game thread takes the last batch itself instead of just sitting around.
+		VoxelJobGroup trace_jobs;
+
+		int first = 0;
+		for (; first + TRACE_BATCH_SIZE < count; first += TRACE_BATCH_SIZE) {
+			int last = first + TRACE_BATCH_SIZE;
+			trace_jobs.run(getThreadPool(), [run_traces, first, last]() {
+				run_traces(first, last);
+			});
+		}
+
+		run_traces(first, count);
+
+		trace_jobs.wait();
+	}
+
+	if (bails > 0)
+		vox_print("[bail] %i of %i batched %s traces", bails.load(), count, hull ? "hull" : "line");
+}
+
+// Voxel a coordinate is in, and how far into it. Plain casts and fmod round towards zero, which is wrong for the negative
+// coordinates huge worlds have.
+static inline Coord floorCoord(double v) {
+	return (Coord)floor(v);
+}
+
+static inline double fracPart(double v) {
+	return v - floor(v);
+}
+
 // Fast trace function, based on http://www.cse.chalmers.se/edu/year/2011/course/TDA361/Advanced%20Computer%20Graphics/grid.pdf
 VoxelTraceRes VoxelWorld::iTrace(Vector startPos, Vector delta, Vector defNormal) {
-	int vx = startPos.x;
-	int vy = startPos.y;
-	int vz = startPos.z;
+	Coord vx = floorCoord(startPos.x);
+	Coord vy = floorCoord(startPos.y);
+	Coord vz = floorCoord(startPos.z);
+
+	VoxelCursor cursor(this, vx, vy, vz);
 
-	BlockData vdata = get(vx, vy, vz);
+	BlockData vdata = cursor.get();
 	VoxelType& vt = config.voxelTypes[vdata];
 	if (vt.form == VFORM_CUBE) {
 		VoxelTraceRes res;
@@ -607,29 +1696,29 @@ VoxelTraceRes VoxelWorld::iTrace(Vector startPos, Vector delta, Vector defNormal
 
 	if (delta.x >= 0) {
 		stepX = 1;
-		tMaxX = (1 - fmod(startPos.x, 1)) / delta.x;
+		tMaxX = (1 - fracPart(startPos.x)) / delta.x;
 	}
 	else {
 		stepX = -1;
-		tMaxX = fmod(startPos.x, 1) / -delta.x;
+		tMaxX = fracPart(startPos.x) / -delta.x;
 	}
 
 	if (delta.y >= 0) {
 		stepY = 1;
-		tMaxY = (1 - fmod(startPos.y, 1)) / delta.y;
+		tMaxY = (1 - fracPart(startPos.y)) / delta.y;
 	}
 	else {
 		stepY = -1;
-		tMaxY = fmod(startPos.y, 1) / -delta.y;
+		tMaxY = fracPart(startPos.y) / -delta.y;
 	}
 
 	if (delta.z >= 0) {
 		stepZ = 1;
-		tMaxZ = (1 - fmod(startPos.z, 1)) / delta.z;
+		tMaxZ = (1 - fracPart(startPos.z)) / delta.z;
 	}
 	else {
 		stepZ = -1;
-		tMaxZ = fmod(startPos.z, 1) / -delta.z;
+		tMaxZ = fracPart(startPos.z) / -delta.z;
 	}
 
 	double tDeltaX = fabs(1 / delta.x);
@@ -638,6 +1727,43 @@ VoxelTraceRes VoxelWorld::iTrace(Vector startPos, Vector delta, Vector defNormal
 
 	int failsafe = 0;
 	while (failsafe++<10000) {
+		// Nothing to hit in an empty or missing chunk. Walk the DDA up to where the ray leaves it without reading anything,
+		// so the step below goes straight into the next chunk.
+		VoxelChunk* chunk = cursor.getChunk();
+		if (chunk == nullptr || chunk->isEmpty()) {
+			int left_x = stepX > 0 ? VOXEL_CHUNK_SIZE - 1 - cursor.getLocalX() : cursor.getLocalX();
+			int left_y = stepY > 0 ? VOXEL_CHUNK_SIZE - 1 - cursor.getLocalY() : cursor.getLocalY();
+			int left_z = stepZ > 0 ? VOXEL_CHUNK_SIZE - 1 - cursor.getLocalZ() : cursor.getLocalZ();
+
+			// Checked so we don't multiply infinity by zero on axes the ray doesn't move along
+			double exit_x = left_x == 0 ? tMaxX : tMaxX + left_x*tDeltaX;
+			double exit_y = left_y == 0 ? tMaxY : tMaxY + left_y*tDeltaY;
+			double exit_z = left_z == 0 ? tMaxZ : tMaxZ + left_z*tDeltaZ;
+
+			double t_exit = MIN(exit_x, MIN(exit_y, exit_z));
+
+			// Ray ends in here
+			if (t_exit > 1)
+				return VoxelTraceRes();
+
+			for (int i = 0; i < left_x && tMaxX < t_exit; i++) {
+				vx += stepX;
+				tMaxX += tDeltaX;
+			}
+
+			for (int i = 0; i < left_y && tMaxY < t_exit; i++) {
+				vy += stepY;
+				tMaxY += tDeltaY;
+			}
+
+			for (int i = 0; i < left_z && tMaxZ < t_exit; i++) {
+				vz += stepZ;
+				tMaxZ += tDeltaZ;
+			}
+
+			cursor.moveTo(vx, vy, vz);
+		}
+
 		byte dir = 0;
 		if (tMaxX < tMaxY) {
 			if (tMaxX < tMaxZ) {
@@ -645,8 +1771,9 @@ VoxelTraceRes VoxelWorld::iTrace(Vector startPos, Vector delta, Vector defNormal
 					return VoxelTraceRes();
 				vx += stepX;
 				tMaxX += tDeltaX;
-				if (vx < 0 || vx >= config.dims_x)
+				if (!config.huge && (vx < 0 || vx >= config.dims_x))
 					return VoxelTraceRes();
+				cursor.stepX(stepX);
 				dir = stepX > 0 ? DIR_X_POS : DIR_X_NEG;
 			}
 			else {
@@ -654,8 +1781,9 @@ VoxelTraceRes VoxelWorld::iTrace(Vector startPos, Vector delta, Vector defNormal
 					return VoxelTraceRes();
 				vz += stepZ;
 				tMaxZ += tDeltaZ;
-				if (vz < 0 || vz >= config.dims_z)
+				if (!config.huge && (vz < 0 || vz >= config.dims_z))
 					return VoxelTraceRes();
+				cursor.stepZ(stepZ);
 				dir = stepZ > 0 ? DIR_Z_POS : DIR_Z_NEG;
 			}
 		}
@@ -665,8 +1793,9 @@ VoxelTraceRes VoxelWorld::iTrace(Vector startPos, Vector delta, Vector defNormal
 					return VoxelTraceRes();
 				vy += stepY;
 				tMaxY += tDeltaY;
-				if (vy < 0 || vy >= config.dims_y)
+				if (!config.huge && (vy < 0 || vy >= config.dims_y))
 					return VoxelTraceRes();
+				cursor.stepY(stepY);
 				dir = stepY > 0 ? DIR_Y_POS : DIR_Y_NEG;
 			}
 			else {
@@ -674,12 +1803,13 @@ VoxelTraceRes VoxelWorld::iTrace(Vector startPos, Vector delta, Vector defNormal
 					return VoxelTraceRes();
 				vz += stepZ;
 				tMaxZ += tDeltaZ;
-				if (vz < 0 || vz >= config.dims_z)
+				if (!config.huge && (vz < 0 || vz >= config.dims_z))
 					return VoxelTraceRes();
+				cursor.stepZ(stepZ);
 				dir = stepZ > 0 ? DIR_Z_POS : DIR_Z_NEG;
 			}
 		}
-		BlockData vdata = get(vx, vy, vz);
+		BlockData vdata = cursor.get();
 		VoxelType& vt = config.voxelTypes[vdata];
 		if (vt.form == VFORM_CUBE) {
 			VoxelTraceRes res;
@@ -712,8 +1842,9 @@ VoxelTraceRes VoxelWorld::iTrace(Vector startPos, Vector delta, Vector defNormal
 		}
 	}
 
-	vox_print("[bail] %f %f %f :: %f %f %f", startPos.x, startPos.y, startPos.z, delta.x, delta.y, delta.z);
-	return VoxelTraceRes();
+	VoxelTraceRes res;
+	res.bailed = true;
+	return res;
 }
 
 int floorCrazy(float f) {
@@ -728,10 +1859,14 @@ int floorCrazy(float f) {
 VoxelTraceRes VoxelWorld::iTraceHull(Vector startPos, Vector delta, Vector extents, Vector defNormal) {
 	double epsilon = .001;
 
-	for (int ix = startPos.x - extents.x + epsilon; ix <= startPos.x + extents.x-epsilon; ix++) {
-		for (int iy = startPos.y - extents.y + epsilon; iy <= startPos.y + extents.y-epsilon; iy++) {
-			for (int iz = startPos.z + epsilon; iz <= startPos.z + extents.z * 2-epsilon; iz++) {
-				BlockData vdata = get(ix, iy, iz);
+	// The sweeps below jump around a small box, but it's almost always inside one or two chunks
+	VoxelCursor cursor(this, floorCoord(startPos.x), floorCoord(startPos.y), floorCoord(startPos.z));
+
+	for (Coord ix = floorCoord(startPos.x - extents.x + epsilon); ix <= startPos.x + extents.x-epsilon; ix++) {
+		for (Coord iy = floorCoord(startPos.y - extents.y + epsilon); iy <= startPos.y + extents.y-epsilon; iy++) {
+			for (Coord iz = floorCoord(startPos.z + epsilon); iz <= startPos.z + extents.z * 2-epsilon; iz++) {
+				cursor.moveTo(ix, iy, iz);
+				BlockData vdata = cursor.get();
 				VoxelType& vt = config.voxelTypes[vdata];
 				if (vt.form == VFORM_CUBE) {
 					VoxelTraceRes res;
@@ -744,53 +1879,53 @@ VoxelTraceRes VoxelWorld::iTraceHull(Vector startPos, Vector delta, Vector exten
 		}
 	}
 
-	int vx, vy, vz;
+	Coord vx, vy, vz;
 	int stepX, stepY, stepZ;
 	double tMaxX, tMaxY, tMaxZ;
 
 	if (delta.x >= 0) {
-		vx = startPos.x + extents.x - epsilon;
+		vx = floorCoord(startPos.x + extents.x - epsilon);
 		stepX = 1;
-		double mod = fmod(startPos.x + extents.x, 1);
+		double mod = fracPart(startPos.x + extents.x);
 		if (mod == 0)
 			tMaxX = 0;
 		else
 			tMaxX = (1 - mod) / delta.x;
 	}
 	else {
-		vx = startPos.x - extents.x + epsilon;
+		vx = floorCoord(startPos.x - extents.x + epsilon);
 		stepX = -1;
-		tMaxX = fmod(startPos.x - extents.x, 1) / -delta.x;
+		tMaxX = fracPart(startPos.x - extents.x) / -delta.x;
 	}
 
 	if (delta.y >= 0) {
-		vy = startPos.y + extents.y - epsilon;
+		vy = floorCoord(startPos.y + extents.y - epsilon);
 		stepY = 1;
-		double mod = fmod(startPos.y + extents.y, 1);
+		double mod = fracPart(startPos.y + extents.y);
 		if (mod == 0)
 			tMaxY = 0;
 		else
 			tMaxY = (1 - mod) / delta.y;
 	}
 	else {
-		vy = startPos.y - extents.y + epsilon;
+		vy = floorCoord(startPos.y - extents.y + epsilon);
 		stepY = -1;
-		tMaxY = fmod(startPos.y - extents.y, 1) / -delta.y;
+		tMaxY = fracPart(startPos.y - extents.y) / -delta.y;
 	}
 
 	if (delta.z >= 0) {
-		vz = startPos.z + extents.z * 2 - epsilon;
+		vz = floorCoord(startPos.z + extents.z * 2 - epsilon);
 		stepZ = 1;
-		double mod = fmod(startPos.z + extents.z * 2, 1);
+		double mod = fracPart(startPos.z + extents.z * 2);
 		if (mod == 0)
 			tMaxZ = 0;
 		else
 			tMaxZ = (1 - mod) / delta.z;
 	}
 	else {
-		vz = startPos.z + epsilon;
+		vz = floorCoord(startPos.z + epsilon);
 		stepZ = -1;
-		tMaxZ = fmod(startPos.z, 1) / -delta.z;
+		tMaxZ = fracPart(startPos.z) / -delta.z;
 	}
 
 	double tDeltaX = fabs(1 / delta.x);
@@ -807,7 +1942,7 @@ VoxelTraceRes VoxelWorld::iTraceHull(Vector startPos, Vector delta, Vector exten
 					return VoxelTraceRes();
 				vx += stepX;
 				tMaxX += tDeltaX;
-				if (vx < 0 || vx >= config.dims_x)
+				if (!config.huge && (vx < 0 || vx >= config.dims_x))
 					return VoxelTraceRes();
 				dir = stepX > 0 ? DIR_X_POS : DIR_X_NEG;
 			}
@@ -816,7 +1951,7 @@ VoxelTraceRes VoxelWorld::iTraceHull(Vector startPos, Vector delta, Vector exten
 					return VoxelTraceRes();
 				vz += stepZ;
 				tMaxZ += tDeltaZ;
-				if (vz < 0 || vz >= config.dims_z)
+				if (!config.huge && (vz < 0 || vz >= config.dims_z))
 					return VoxelTraceRes();
 				dir = stepZ > 0 ? DIR_Z_POS : DIR_Z_NEG;
 			}
@@ -827,7 +1962,7 @@ VoxelTraceRes VoxelWorld::iTraceHull(Vector startPos, Vector delta, Vector exten
 					return VoxelTraceRes();
 				vy += stepY;
 				tMaxY += tDeltaY;
-				if (vy < 0 || vy >= config.dims_y)
+				if (!config.huge && (vy < 0 || vy >= config.dims_y))
 					return VoxelTraceRes();
 				dir = stepY > 0 ? DIR_Y_POS : DIR_Y_NEG;
 			}
@@ -836,7 +1971,7 @@ VoxelTraceRes VoxelWorld::iTraceHull(Vector startPos, Vector delta, Vector exten
 					return VoxelTraceRes();
 				vz += stepZ;
 				tMaxZ += tDeltaZ;
-				if (vz < 0 || vz >= config.dims_z)
+				if (!config.huge && (vz < 0 || vz >= config.dims_z))
 					return VoxelTraceRes();
 				dir = stepZ > 0 ? DIR_Z_POS : DIR_Z_NEG;
 			}
@@ -846,9 +1981,10 @@ VoxelTraceRes VoxelWorld::iTraceHull(Vector startPos, Vector delta, Vector exten
 			double t = tMaxX - tDeltaX;
 			double baseY = startPos.y + t*delta.y;
 			double baseZ = startPos.z + t*delta.z;
-			for (int iy = baseY - extents.y + epsilon; iy <= baseY + extents.y - epsilon; iy++) {
-				for (int iz = baseZ + epsilon; iz <= baseZ + extents.z * 2 - epsilon; iz++) {
-					BlockData vdata = get(vx, iy, iz);
+			for (Coord iy = floorCoord(baseY - extents.y + epsilon); iy <= baseY + extents.y - epsilon; iy++) {
+				for (Coord iz = floorCoord(baseZ + epsilon); iz <= baseZ + extents.z * 2 - epsilon; iz++) {
+					cursor.moveTo(vx, iy, iz);
+					BlockData vdata = cursor.get();
 					VoxelType& vt = config.voxelTypes[vdata];
 					if (vt.form == VFORM_CUBE) {
 						VoxelTraceRes res;
@@ -873,9 +2009,10 @@ VoxelTraceRes VoxelWorld::iTraceHull(Vector startPos, Vector delta, Vector exten
 			double t = tMaxY - tDeltaY;
 			double baseX = startPos.x + t*delta.x;
 			double baseZ = startPos.z + t*delta.z;
-			for (int ix = baseX - extents.x + epsilon; ix <= baseX + extents.x - epsilon; ix++) {
-				for (int iz = baseZ + epsilon; iz <= baseZ + extents.z * 2 - epsilon; iz++) {
-					BlockData vdata = get(ix, vy, iz);
+			for (Coord ix = floorCoord(baseX - extents.x + epsilon); ix <= baseX + extents.x - epsilon; ix++) {
+				for (Coord iz = floorCoord(baseZ + epsilon); iz <= baseZ + extents.z * 2 - epsilon; iz++) {
+					cursor.moveTo(ix, vy, iz);
+					BlockData vdata = cursor.get();
 					VoxelType& vt = config.voxelTypes[vdata];
 					if (vt.form == VFORM_CUBE) {
 						VoxelTraceRes res;
@@ -900,9 +2037,10 @@ VoxelTraceRes VoxelWorld::iTraceHull(Vector startPos, Vector delta, Vector exten
 			double t = tMaxZ - tDeltaZ;
 			double baseX = startPos.x + t*delta.x;
 			double baseY = startPos.y + t*delta.y;
-			for (int ix = baseX - extents.x + epsilon; ix <= baseX + extents.x - epsilon; ix++) {
-				for (int iy = baseY - extents.y + epsilon; iy <= baseY + extents.y - epsilon; iy++) {
-					BlockData vdata = get(ix, iy, vz);
+			for (Coord ix = floorCoord(baseX - extents.x + epsilon); ix <= baseX + extents.x - epsilon; ix++) {
+				for (Coord iy = floorCoord(baseY - extents.y + epsilon); iy <= baseY + extents.y - epsilon; iy++) {
+					cursor.moveTo(ix, iy, vz);
+					BlockData vdata = cursor.get();
 					VoxelType& vt = config.voxelTypes[vdata];
 					if (vt.form == VFORM_CUBE) {
 						VoxelTraceRes res;
@@ -926,8 +2064,9 @@ VoxelTraceRes VoxelWorld::iTraceHull(Vector startPos, Vector delta, Vector exten
 
 	}
 
-	vox_print("[bail-hull] %i %i %i", vx, vy, vz);
-	return VoxelTraceRes();
+	VoxelTraceRes res;
+	res.bailed = true;
+	return res;
 }
 
 // Render every single chunk.
@@ -941,103 +2080,382 @@ void VoxelWorld::draw() {
 	//Bind material
 	pRenderContext->Bind(atlasMat);
 
-	//Set lighting
-	Vector4D lighting_cube[] = { Vector4D(.7, .7, .7, 1), Vector4D(.3, .3, .3, 1), Vector4D(.5, .5, .5, 1), Vector4D(.5, .5, .5, 1), Vector4D(1, 1, 1, 1), Vector4D(.1, .1, .1, 1) };
-	pRenderContext->SetAmbientLightCube(lighting_cube);
-	pRenderContext->SetAmbientLight(0, 0, 0);
-	pRenderContext->DisableAllLocalLights();
+	//Set lighting
+	Vector4D lighting_cube[] = { Vector4D(.7, .7, .7, 1), Vector4D(.3, .3, .3, 1), Vector4D(.5, .5, .5, 1), Vector4D(.5, .5, .5, 1), Vector4D(1, 1, 1, 1), Vector4D(.1, .1, .1, 1) };
+	pRenderContext->SetAmbientLightCube(lighting_cube);
+	pRenderContext->SetAmbientLight(0, 0, 0);
+	pRenderContext->DisableAllLocalLights();
+
+	// TODO: only draw nearby chunks
+	for (VoxelChunk* chunk : chunks_map) {
+		chunk->draw(pRenderContext);
+	}
+}
+
+//floored division, credit http://www.microhowto.info/howto/round_towards_minus_infinity_when_dividing_integers_in_c_or_c++.html
+int div_floor(int x, int y) {
+	int q = x / y;
+	int r = x%y;
+	if ((r != 0) && ((r<0) != (y<0))) --q;
+	return q;
+}
+
+// Gets a voxel given VOXEL COORDINATES -- NOT WORLD COORDINATES OR COORDINATES LOCAL TO ENT -- THOSE ARE HANDLED BY LUA CHUNK
+BlockData VoxelWorld::get(Coord x, Coord y, Coord z) {
+	Coord cx = div_floor(x, VOXEL_CHUNK_SIZE);
+	Coord cy = div_floor(y, VOXEL_CHUNK_SIZE);
+	Coord cz = div_floor(z, VOXEL_CHUNK_SIZE);
+
+	VoxelChunk* chunk = getChunk(cx, cy, cz);
+	if (chunk == nullptr) {
+		return 0;
+	}
+	return chunk->get(x - cx*VOXEL_CHUNK_SIZE, y - cy*VOXEL_CHUNK_SIZE, z - cz*VOXEL_CHUNK_SIZE);
+}
+
+// Sets a voxel given VOXEL COORDINATES -- NOT WORLD COORDINATES OR COORDINATES LOCAL TO ENT -- THOSE ARE HANDLED BY LUA CHUNK
+bool VoxelWorld::set(Coord x, Coord y, Coord z, BlockData d, bool flagChunks) {
+	if (!config.huge && (x >= config.dims_x || y >= config.dims_y || z >= config.dims_z))
+		return false;
+
+	Coord cx = div_floor(x, VOXEL_CHUNK_SIZE);
+	Coord cy = div_floor(y, VOXEL_CHUNK_SIZE);
+	Coord cz = div_floor(z, VOXEL_CHUNK_SIZE);
+
+	VoxelChunk* chunk = getChunkForEdit(cx, cy, cz);
+	if (chunk == nullptr)
+		return false;
+
+	Coord lx = x - cx*VOXEL_CHUNK_SIZE;
+	Coord ly = y - cy*VOXEL_CHUNK_SIZE;
+	Coord lz = z - cz*VOXEL_CHUNK_SIZE;
+
+	chunk->set(lx, ly, lz, d, flagChunks);
+	chunk->last_used = ++use_clock;
+
+#ifdef VOXELATE_SERVER
+	ChunkEdits& edits = edit_journal[{ cx, cy, cz }];
+	int i = lx + ly*VOXEL_CHUNK_SIZE + lz*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE;
+	edits.changed[i] = true;
+	edits.values[i] = d;
+#endif
+
+	return true;
+}
+
+void VoxelWorld::flagChunk(XYZCoordinate chunk_pos, bool high_priority)
+{
+	if (!dirty_chunk_set.count(chunk_pos)) {
+		dirty_chunk_set.insert(chunk_pos);
+		if (high_priority) {
+			dirty_chunk_queue.push_front(chunk_pos);
+		}
+		else {
+			dirty_chunk_queue.push_back(chunk_pos);
+		}
+	}
+}
+
+VoxelChunk* VoxelWorld::getChunkForEdit(Coord x, Coord y, Coord z) {
+	if (config.huge && IS_SERVERSIDE)
+		return loadChunk(x, y, z);
+
+	return getChunk(x, y, z);
+}
+
+void VoxelWorld::flagChunkSides(XYZCoordinate chunk_pos, bool low_x, bool low_y, bool low_z) {
+	flagChunk(chunk_pos, true);
+
+	if (low_x)
+		flagChunk({ chunk_pos[0] - 1, chunk_pos[1], chunk_pos[2] }, true);
+
+	if (low_y)
+		flagChunk({ chunk_pos[0], chunk_pos[1] - 1, chunk_pos[2] }, true);
+
+	if (low_z)
+		flagChunk({ chunk_pos[0], chunk_pos[1], chunk_pos[2] - 1 }, true);
+}
+
+// Shared part of fillRegion and fillSphere. Walks every chunk in the bounds, and for each row of voxels (fixed y and z)
+// asks row_span(y, z, x_first, x_last) which x range to fill, inclusive. Returning false skips the row.
+// Chunks get asked chunk_hit(min_x, min_y, min_z, max_x, max_y, max_z) with their part of the bounds first, so huge worlds don't load
+// chunks the shape misses.
+template<typename ChunkHitFn, typename RowSpanFn>
+bool VoxelWorld::fillRows(long long box_min_x, long long box_min_y, long long box_min_z, long long box_max_x, long long box_max_y, long long box_max_z, BlockData d,
+	ChunkHitFn chunk_hit, RowSpanFn row_span) {
+	// Past the limit, the chunk and row math below could overflow a Coord
+	if (box_min_x < -VOXEL_COORD_LIMIT || box_min_y < -VOXEL_COORD_LIMIT || box_min_z < -VOXEL_COORD_LIMIT ||
+		box_max_x > VOXEL_COORD_LIMIT || box_max_y > VOXEL_COORD_LIMIT || box_max_z > VOXEL_COORD_LIMIT)
+		return false;
+
+	Coord min_x = (Coord)box_min_x;
+	Coord min_y = (Coord)box_min_y;
+	Coord min_z = (Coord)box_min_z;
+	Coord max_x = (Coord)box_max_x;
+	Coord max_y = (Coord)box_max_y;
+	Coord max_z = (Coord)box_max_z;
+
+	if (!config.huge) {
+		min_x = MAX(min_x, 0);
+		min_y = MAX(min_y, 0);
+		min_z = MAX(min_z, 0);
+		max_x = MIN(max_x, config.dims_x - 1);
+		max_y = MIN(max_y, config.dims_y - 1);
+		max_z = MIN(max_z, config.dims_z - 1);
+	}
+
+	if (min_x > max_x || min_y > max_y || min_z > max_z)
+		return false;
+
+	Coord min_cx = div_floor(min_x, VOXEL_CHUNK_SIZE);
+	Coord min_cy = div_floor(min_y, VOXEL_CHUNK_SIZE);
+	Coord min_cz = div_floor(min_z, VOXEL_CHUNK_SIZE);
+	Coord max_cx = div_floor(max_x, VOXEL_CHUNK_SIZE);
+	Coord max_cy = div_floor(max_y, VOXEL_CHUNK_SIZE);
+	Coord max_cz = div_floor(max_z, VOXEL_CHUNK_SIZE);
+
+	// Every chunk that gets filled has to be loaded first, and they can't be evicted until the next tick.
+	// Anything bigger than the world is allowed to keep loaded gets turned down instead of loading it all.
+	if (config.huge && IS_SERVERSIDE) {
+		long long span_x = (long long)max_cx - min_cx + 1;
+		long long span_y = (long long)max_cy - min_cy + 1;
+		long long span_z = (long long)max_cz - min_cz + 1;
+
+		// Two axes at a time, all three multiplied together could overflow
+		if (span_x * span_y > config.maxLoadedChunks || span_x * span_y * span_z > config.maxLoadedChunks) {
+			vox_print("VoxelWorld::fillRows -> %lldx%lldx%lld chunks is more than maxLoadedChunks (%i), nothing was set",
+				span_x, span_y, span_z, config.maxLoadedChunks);
+			return false;
+		}
+	}
+
+	bool changed = false;
+
+	for (Coord cz = min_cz; cz <= max_cz; cz++) {
+		for (Coord cy = min_cy; cy <= max_cy; cy++) {
+			for (Coord cx = min_cx; cx <= max_cx; cx++) {
+				Coord base_x = cx*VOXEL_CHUNK_SIZE;
+				Coord base_y = cy*VOXEL_CHUNK_SIZE;
+				Coord base_z = cz*VOXEL_CHUNK_SIZE;
+
+				// Part of the bounds inside this chunk, in world voxels
+				Coord chunk_min_x = MAX(min_x, base_x);
+				Coord chunk_max_x = MIN(max_x, base_x + VOXEL_CHUNK_SIZE - 1);
+				Coord chunk_min_y = MAX(min_y, base_y);
+				Coord chunk_max_y = MIN(max_y, base_y + VOXEL_CHUNK_SIZE - 1);
+				Coord chunk_min_z = MAX(min_z, base_z);
+				Coord chunk_max_z = MIN(max_z, base_z + VOXEL_CHUNK_SIZE - 1);
+
+				if (!chunk_hit(chunk_min_x, chunk_min_y, chunk_min_z, chunk_max_x, chunk_max_y, chunk_max_z))
+					continue;
+
+				VoxelChunk* chunk = getChunkForEdit(cx, cy, cz);
+				if (chunk == nullptr)
+					continue;
+
+				BlockData raw[VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
+				bool unpacked = false;
+
+#ifdef VOXELATE_SERVER
+				ChunkEdits* edits = nullptr;
+#endif
+
+				// Same neighbors VoxelChunk::set flags, if we touched their side of the chunk
+				bool touched_low_x = false;
+				bool touched_low_y = false;
+				bool touched_low_z = false;
+
+				for (Coord z = chunk_min_z; z <= chunk_max_z; z++) {
+					for (Coord y = chunk_min_y; y <= chunk_max_y; y++) {
+						Coord x_first, x_last;
+						if (!row_span(y, z, x_first, x_last))
+							continue;
+
+						x_first = MAX(x_first, chunk_min_x);
+						x_last = MIN(x_last, chunk_max_x);
+						if (x_first > x_last)
+							continue;
+
+						if (!unpacked) {
+							chunk->getData().unpack(raw);
+							unpacked = true;
+
+#ifdef VOXELATE_SERVER
+							edits = &edit_journal[{ cx, cy, cz }];
+#endif
+						}
+
+						int row_start = (y - base_y)*VOXEL_CHUNK_SIZE + (z - base_z)*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE;
+						std::fill(raw + row_start + (x_first - base_x), raw + row_start + (x_last - base_x) + 1, d);
+
+#ifdef VOXELATE_SERVER
+						for (int i = row_start + (x_first - base_x); i <= row_start + (x_last - base_x); i++) {
+							edits->changed[i] = true;
+							edits->values[i] = d;
+						}
+#endif
+
+						touched_low_x |= x_first == base_x;
+						touched_low_y |= y == base_y;
+						touched_low_z |= z == base_z;
+					}
+				}
+
+				if (!unpacked)
+					continue;
+
+				chunk->setAll(raw);
+				chunk->last_used = ++use_clock;
+				changed = true;
 
-	// TODO: only draw nearby chunks
-	for (auto pair : chunks_map) {
-		pair.second->draw(pRenderContext);
+				flagChunkSides({ cx, cy, cz }, touched_low_x, touched_low_y, touched_low_z);
+			}
+		}
 	}
-}
 
-//floored division, credit http://www.microhowto.info/howto/round_towards_minus_infinity_when_dividing_integers_in_c_or_c++.html
-int div_floor(int x, int y) {
-	int q = x / y;
-	int r = x%y;
-	if ((r != 0) && ((r<0) != (y<0))) --q;
-	return q;
+	return changed;
 }
 
-// Gets a voxel given VOXEL COORDINATES -- NOT WORLD COORDINATES OR COORDINATES LOCAL TO ENT -- THOSE ARE HANDLED BY LUA CHUNK
-BlockData VoxelWorld::get(Coord x, Coord y, Coord z) {
-	int qx = x / VOXEL_CHUNK_SIZE;
-
+bool VoxelWorld::fillRegion(Coord min_x, Coord min_y, Coord min_z, Coord max_x, Coord max_y, Coord max_z, BlockData d) {
+	// A box touches every chunk in its bounds
+	auto chunk_hit = [](Coord, Coord, Coord, Coord, Coord, Coord) {
+		return true;
+	};
 
-	VoxelChunk* chunk = getChunk(div_floor(x,VOXEL_CHUNK_SIZE), div_floor(y,VOXEL_CHUNK_SIZE), div_floor(z,VOXEL_CHUNK_SIZE));
-	if (chunk == nullptr) {
-		return 0;
-	}
-	return chunk->get(x % VOXEL_CHUNK_SIZE, y % VOXEL_CHUNK_SIZE, z % VOXEL_CHUNK_SIZE);
+	return fillRows(min_x, min_y, min_z, max_x, max_y, max_z, d, chunk_hit, [min_x, max_x](Coord, Coord, Coord& x_first, Coord& x_last) {
+		x_first = min_x;
+		x_last = max_x;
+		return true;
+	});
 }
 
-// Sets a voxel given VOXEL COORDINATES -- NOT WORLD COORDINATES OR COORDINATES LOCAL TO ENT -- THOSE ARE HANDLED BY LUA CHUNK
-bool VoxelWorld::set(Coord x, Coord y, Coord z, BlockData d, bool flagChunks) {
-	VoxelChunk* chunk = getChunk(div_floor(x, VOXEL_CHUNK_SIZE), div_floor(y, VOXEL_CHUNK_SIZE), div_floor(z, VOXEL_CHUNK_SIZE));
-	if (chunk == nullptr || (!config.huge && (x>= config.dims_x || y>= config.dims_y || z >= config.dims_z)))
+// Everything within r of the center, distance measured between voxel coordinates.
+bool VoxelWorld::fillSphere(Coord x, Coord y, Coord z, Coord r, BlockData d) {
+	if (r < 0)
 		return false;
 
-	chunk->set(x % VOXEL_CHUNK_SIZE, y % VOXEL_CHUNK_SIZE, z % VOXEL_CHUNK_SIZE, d, flagChunks);
-	return true;
-}
+	long long r_sqr = (long long)r*r;
 
-void VoxelWorld::flagChunk(XYZCoordinate chunk_pos, bool high_priority)
-{
-	if (!dirty_chunk_set.count(chunk_pos)) {
-		dirty_chunk_set.insert(chunk_pos);
-		if (high_priority) {
-			dirty_chunk_queue.push_front(chunk_pos);
-		}
-		else {
-			dirty_chunk_queue.push_back(chunk_pos);
-		}
-	}
+	// Distance from the center to the nearest voxel in the box along one axis
+	auto gap = [](Coord v, Coord lo, Coord hi) -> long long {
+		return v < lo ? (long long)lo - v : v > hi ? (long long)v - hi : 0;
+	};
+
+	auto chunk_hit = [x, y, z, r_sqr, gap](Coord lo_x, Coord lo_y, Coord lo_z, Coord hi_x, Coord hi_y, Coord hi_z) {
+		long long dx = gap(x, lo_x, hi_x);
+		long long dy = gap(y, lo_y, hi_y);
+		long long dz = gap(z, lo_z, hi_z);
+		return dx*dx + dy*dy + dz*dz <= r_sqr;
+	};
+
+	// Bounds in long long, a big enough r would overflow a Coord. fillRows turns those down.
+	long long min_x = (long long)x - r;
+	long long min_y = (long long)y - r;
+	long long min_z = (long long)z - r;
+	long long max_x = (long long)x + r;
+	long long max_y = (long long)y + r;
+	long long max_z = (long long)z + r;
+
+	return fillRows(min_x, min_y, min_z, max_x, max_y, max_z, d, chunk_hit, [x, y, z, r_sqr](Coord row_y, Coord row_z, Coord& x_first, Coord& x_last) {
+		long long dy = (long long)row_y - y;
+		long long dz = (long long)row_z - z;
+		long long remaining = r_sqr - dy*dy - dz*dz;
+		if (remaining < 0)
+			return false;
+
+		// Widest dx with dx*dx <= remaining. sqrt gets close, then fix up any rounding.
+		long long dx = (long long)std::sqrt((double)remaining);
+		while (dx*dx > remaining)
+			dx--;
+		while ((dx + 1)*(dx + 1) <= remaining)
+			dx++;
+
+		x_first = x - (Coord)dx;
+		x_last = x + (Coord)dx;
+		return true;
+	});
 }
 
 // Most shit inside chunks should just work with huge maps
-// The one thing that comes to mind is mesh generation, which always builds the chunk offset into the mesh
-// I beleive I did this so I wouldn't need to push a matrix for every single chunk (lots of chunks, could be expensive?)
-// Could run into FP issues if we keep the offset built in though, as I'm pretty sure meshes use 32bit floats
+// Render meshes are chunk local now, with a matrix pushed per chunk, so they don't run into FP issues far from the origin.
+// Physics meshes still have the chunk offset built in.
 VoxelChunk::VoxelChunk(VoxelWorld* sys,int cx, int cy, int cz) {
 	system = sys;
 	posX = cx;
 	posY = cy;
 	posZ = cz;
+
+	voxel_data = std::make_shared<PalettedBlockStorage>();
+
+	updateEmpty();
 }
 
 VoxelChunk::~VoxelChunk() {
 	meshClearAll();
 }
 
-// todo allow any function to be used for generation, based on config
 void VoxelChunk::generate() {
 	int offset_x = posX*VOXEL_CHUNK_SIZE;
 	int offset_y = posY*VOXEL_CHUNK_SIZE;
 	int offset_z = posZ*VOXEL_CHUNK_SIZE;
 
-	int max_x = system->config.huge ? VOXEL_CHUNK_SIZE : MIN(system->config.dims_x - offset_x, VOXEL_CHUNK_SIZE);
-	int max_y = system->config.huge ? VOXEL_CHUNK_SIZE : MIN(system->config.dims_y - offset_y, VOXEL_CHUNK_SIZE);
-	int max_z = system->config.huge ? VOXEL_CHUNK_SIZE : MIN(system->config.dims_z - offset_z, VOXEL_CHUNK_SIZE);
-
-	for (int x = 0; x < max_x; x++) {
-		for (int y = 0; y < max_y; y++) {
-			for (int z = 0; z < max_z; z++) {
-				auto block = vox_worldgen_basic(offset_x+x, offset_y+y, offset_z+z);
-				set(x, y, z, block, false);
+	// Generate flat and pack once, instead of making the palette grow one set at a time
+	BlockData raw[VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
+	voxGenerateChunk(system->config.generator, offset_x, offset_y, offset_z, raw);
+
+	// Chunks hanging off the edge of a fixed size world keep the outside empty
+	if (!system->config.huge) {
+		int max_x = MIN(system->config.dims_x - offset_x, VOXEL_CHUNK_SIZE);
+		int max_y = MIN(system->config.dims_y - offset_y, VOXEL_CHUNK_SIZE);
+		int max_z = MIN(system->config.dims_z - offset_z, VOXEL_CHUNK_SIZE);
+
+		if (max_x < VOXEL_CHUNK_SIZE || max_y < VOXEL_CHUNK_SIZE || max_z < VOXEL_CHUNK_SIZE) {
+			for (int z = 0; z < VOXEL_CHUNK_SIZE; z++) {
+				for (int y = 0; y < VOXEL_CHUNK_SIZE; y++) {
+					for (int x = 0; x < VOXEL_CHUNK_SIZE; x++) {
+						if (x >= max_x || y >= max_y || z >= max_z)
+							raw[x + y*VOXEL_CHUNK_SIZE + z*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE] = 0;
+					}
+				}
 			}
 		}
 	}
+
+	setAll(raw);
 }
 
+// Synchronous build, meshes and uploads right here on the game thread.
 void VoxelChunk::build(CBaseEntity* ent) {
+	VoxelMeshInput input;
+	VoxelChunkSnapshot snap;
+	snapshotForMeshing(input, snap);
+	unpackMeshInput(snap, input);
 
-	meshClearAll();
+	std::vector<VoxelQuad> quads;
+	buildChunkMesh(input, quads);
+
+	uploadMesh(quads, ent);
+}
+
+VoxelChunkSnapshot VoxelChunk::snapshot() {
+	VoxelChunkSnapshot snap;
+	snap.center = voxel_data;
+	snap.version = version;
 
-	VoxelChunk* next_chunk_x = system->getChunk(posX + 1, posY, posZ);
-	VoxelChunk* next_chunk_y = system->getChunk(posX, posY + 1, posZ);
-	VoxelChunk* next_chunk_z = system->getChunk(posX, posY, posZ + 1);
+	static const int offsets[6][3] = { { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+
+	for (int i = 0; i < 6; i++) {
+		VoxelChunk* neighbor = system->getChunk(posX + offsets[i][0], posY + offsets[i][1], posZ + offsets[i][2]);
+		if (neighbor != nullptr)
+			snap.neighbors[i] = neighbor->voxel_data;
+	}
+
+	return snap;
+}
+
+// Pins the voxels instead of copying them, so the chunk is free to change while the job runs.
+void VoxelChunk::snapshotForMeshing(VoxelMeshInput& input, VoxelChunkSnapshot& snap) {
+	snap = snapshot();
 
 	bool huge = system->config.huge;
 	bool buildExterior = system->config.buildExterior;
@@ -1048,13 +2466,13 @@ void VoxelChunk::build(CBaseEntity* ent) {
 	int hard_upper_bound_y = (system->config.dims_y - posY*VOXEL_CHUNK_SIZE);
 	int hard_upper_bound_z = (system->config.dims_z - posZ*VOXEL_CHUNK_SIZE);
 
-	int upper_bound_x = !huge && hard_upper_bound_x < VOXEL_CHUNK_SIZE ? hard_upper_bound_x : VOXEL_CHUNK_SIZE;
-	int upper_bound_y = !huge && hard_upper_bound_y < VOXEL_CHUNK_SIZE ? hard_upper_bound_y : VOXEL_CHUNK_SIZE;
-	int upper_bound_z = !huge && hard_upper_bound_z < VOXEL_CHUNK_SIZE ? hard_upper_bound_z : VOXEL_CHUNK_SIZE;
+	input.upper_bound_x = !huge && hard_upper_bound_x < VOXEL_CHUNK_SIZE ? hard_upper_bound_x : VOXEL_CHUNK_SIZE;
+	input.upper_bound_y = !huge && hard_upper_bound_y < VOXEL_CHUNK_SIZE ? hard_upper_bound_y : VOXEL_CHUNK_SIZE;
+	input.upper_bound_z = !huge && hard_upper_bound_z < VOXEL_CHUNK_SIZE ? hard_upper_bound_z : VOXEL_CHUNK_SIZE;
 
-	int lower_slice_x = !huge && buildExterior && posX == 0 ? -1 : 0;
-	int lower_slice_y = !huge && buildExterior && posY == 0 ? -1 : 0;
-	int lower_slice_z = !huge && buildExterior && posZ == 0 ? -1 : 0;
+	input.lower_slice_x = !huge && buildExterior && posX == 0 ? -1 : 0;
+	input.lower_slice_y = !huge && buildExterior && posY == 0 ? -1 : 0;
+	input.lower_slice_z = !huge && buildExterior && posZ == 0 ? -1 : 0;
 
 	if (!huge && !buildExterior) {
 		hard_upper_bound_x--;
@@ -1062,224 +2480,82 @@ void VoxelChunk::build(CBaseEntity* ent) {
 		hard_upper_bound_z--;
 	}
 
-	int upper_slice_x = !huge && hard_upper_bound_x < VOXEL_CHUNK_SIZE ? hard_upper_bound_x : VOXEL_CHUNK_SIZE;
-	int upper_slice_y = !huge && hard_upper_bound_y < VOXEL_CHUNK_SIZE ? hard_upper_bound_y : VOXEL_CHUNK_SIZE;
-	int upper_slice_z = !huge && hard_upper_bound_z < VOXEL_CHUNK_SIZE ? hard_upper_bound_z : VOXEL_CHUNK_SIZE;
-
-	VoxelType* blockTypes = system->config.voxelTypes;
-
-	SliceFace faces[VOXEL_CHUNK_SIZE][VOXEL_CHUNK_SIZE];
-
-	// Slices along x axis!
-	for (int slice_x = lower_slice_x; slice_x < upper_slice_x; slice_x++) {
+	input.upper_slice_x = !huge && hard_upper_bound_x < VOXEL_CHUNK_SIZE ? hard_upper_bound_x : VOXEL_CHUNK_SIZE;
+	input.upper_slice_y = !huge && hard_upper_bound_y < VOXEL_CHUNK_SIZE ? hard_upper_bound_y : VOXEL_CHUNK_SIZE;
+	input.upper_slice_z = !huge && hard_upper_bound_z < VOXEL_CHUNK_SIZE ? hard_upper_bound_z : VOXEL_CHUNK_SIZE;
 
-		for (int z = 0; z < upper_bound_z; z++) {
-			for (int y = 0; y < upper_bound_y; y++) {
-
-				// Compute base type
-				BlockData base;
-
-				if (slice_x < 0)
-					base = 0;
-				else
-					base = get(slice_x, y, z);
-
-				VoxelType& base_type = blockTypes[base];
-
-				// Compute offset type
-				BlockData offset_x;
-				if (slice_x == VOXEL_CHUNK_SIZE - 1)
-					if (next_chunk_x == nullptr)
-						offset_x = 0;
-					else
-						offset_x = next_chunk_x->get(0, y, z);
-				else
-					offset_x = get(slice_x + 1 , y, z);
+	input.textured = !IS_SERVERSIDE;
+	input.voxelTypes = system->config.voxelTypes;
+}
 
-				VoxelType& offset_x_type = blockTypes[offset_x];
+// Game thread only! Throws out the old meshes and copies the quads into new ones.
+// Render meshes are refilled in place instead, as long as the quads still fit in them.
+void VoxelChunk::uploadMesh(const std::vector<VoxelQuad>& quads, CBaseEntity* ent) {
+	if (!IS_SERVERSIDE) {
+		VoxelMeshPool& pool = system->mesh_pool;
 
-				// Add faces!
-				SliceFace& face = faces[z][y];
+		// We already know exactly how many quads there are, so this is one mesh unless the engine can't take them all at once,
+		// which can't happen at the current chunk size, see MESH_WORST_CASE_QUADS.
+		int total = quads.size();
+		int needed = (total + MESH_MAX_QUADS - 1) / MESH_MAX_QUADS;
 
-				if (base_type.form == VFORM_CUBE && offset_x_type.form == VFORM_NULL) {
-					face.present = true;
-#ifdef VOXELATE_CLIENT
-					face.direction = true;
-					face.texture = base_type.side_xPos;
-#endif
-				}
-				else if (base_type.form == VFORM_NULL && offset_x_type.form == VFORM_CUBE) {
-					face.present = true;
-#ifdef VOXELATE_CLIENT
-					face.direction = false;
-					face.texture = offset_x_type.side_xNeg;
-#endif
-				}
-				else
-					face.present = false;
-			}
+		while ((int)meshes.size() > needed) {
+			pool.release(meshes.back());
+			meshes.pop_back();
 		}
 
-		buildSlice(slice_x, DIR_X_POS, faces, upper_bound_y, upper_bound_z);
-	}
-
-	// Slices along y axis!
-	for (int slice_y = lower_slice_y; slice_y < upper_slice_y; slice_y++) {
-
-		for (int z = 0; z < upper_bound_z; z++) {
-			for (int x = 0; x < upper_bound_x; x++) {
+		meshes.resize(needed);
 
-				// Compute base type
-				BlockData base;
+		for (int i = 0; i < needed; i++) {
+			int first = i * MESH_MAX_QUADS;
+			int count = MIN(total - first, MESH_MAX_QUADS);
 
-				if (slice_y < 0)
-					base = 0;
-				else
-					base = get(x, slice_y, z);
-
-				VoxelType& base_type = blockTypes[base];
-
-				// Compute offset type
-				BlockData offset_y;
-				if (slice_y == VOXEL_CHUNK_SIZE - 1)
-					if (next_chunk_y == nullptr)
-						offset_y = 0;
-					else
-						offset_y = next_chunk_y->get(x, 0, z);
-				else
-					offset_y = get(x, slice_y + 1, z);
+			// Only go back to the pool once we've outgrown what we have
+			VoxelPooledMesh& mesh = meshes[i];
+			if (mesh.capacity < count) {
+				pool.release(mesh);
+				mesh = pool.acquire(count);
+			}
 
-				VoxelType& offset_y_type = blockTypes[offset_y];
+			// Quads draw however many vertices got written, not what we asked for
+			meshBuilder.Begin(mesh.mesh, MATERIAL_QUADS, mesh.capacity);
 
-				// Add faces!
-				SliceFace& face = faces[z][x];
+			for (int q = first; q < first + count; q++)
+				emitQuadVertices(meshBuilder, quads[q]);
 
-				if (base_type.form == VFORM_CUBE && offset_y_type.form == VFORM_NULL) {
-					face.present = true;
-#ifdef VOXELATE_CLIENT
-					face.direction = true;
-					face.texture = base_type.side_yPos;
-#endif
-				}
-				else if (base_type.form == VFORM_NULL && offset_y_type.form == VFORM_CUBE) {
-					face.present = true;
-#ifdef VOXELATE_CLIENT
-					face.direction = false;
-					face.texture = offset_y_type.side_yNeg;
-#endif
-				}
-				else
-					face.present = false;
-			}
+			meshBuilder.End();
 		}
 
-		buildSlice(slice_y, DIR_Y_POS, faces, upper_bound_x, upper_bound_z);
+		return;
 	}
 
-	// Slices along z axis! TODO ALSO PROCESS NON-CUBIC BLOCKS IN -THIS- STAGE
-
-	for (int slice_z = lower_slice_z; slice_z < upper_slice_z; slice_z++) {
-		
-		for (int y = 0; y < upper_bound_y; y++) {
-			for (int x = 0; x < upper_bound_x; x++) {
-				
-				// Compute base type
-				BlockData base;
-
-				if (slice_z < 0)
-					base = 0;
-				else
-					base = get(x, y, slice_z);
-
-				VoxelType& base_type = blockTypes[base];
-
-				// Compute offset type
-				BlockData offset_z;
-				if (slice_z == VOXEL_CHUNK_SIZE - 1)
-					if (next_chunk_z == nullptr)
-						offset_z = 0;
-					else
-						offset_z = next_chunk_z->get(x, y, 0);
-				else
-					offset_z = get(x, y, slice_z + 1);
-
-				VoxelType& offset_z_type = blockTypes[offset_z];
-
-				// Add faces!
-				SliceFace& face = faces[y][x];
-
-				if (base_type.form == VFORM_CUBE && offset_z_type.form == VFORM_NULL) {
-					face.present = true;
-#ifdef VOXELATE_CLIENT
-					face.direction = true;
-					face.texture = base_type.side_zPos;
-#endif
-				}
-				else if (base_type.form == VFORM_NULL && offset_z_type.form == VFORM_CUBE) {
-					face.present = true;
-#ifdef VOXELATE_CLIENT
-					face.direction = false;
-					face.texture = offset_z_type.side_zNeg;
-#endif
-				} else
-					face.present = false;
-			}
-		}
+	meshClearAll();
 
-		buildSlice(slice_z, DIR_Z_POS, faces, upper_bound_x, upper_bound_y);
+	for (const VoxelQuad& quad : quads) {
+		addSliceFace(quad);
 	}
 
 	//final build
 	meshStop(ent);
-
 }
 
-void VoxelChunk::buildSlice(int slice, byte dir, SliceFace faces[VOXEL_CHUNK_SIZE][VOXEL_CHUNK_SIZE], int upper_bound_x, int upper_bound_y) {
-
-	for (int y = 0; y < upper_bound_y; y++) {
-		for (int x = 0; x < upper_bound_x; x++) {
-
-			if (faces[y][x].present) {
-				SliceFace& current_face = faces[y][x];
-
-				int end_x;
-				int end_y;
-
-				for (end_x = x + 1; end_x < upper_bound_x && current_face == faces[y][end_x]; end_x++) {
-					faces[y][end_x].present = false;
-				}
-
-				for (end_y = y + 1; end_y < upper_bound_y; end_y++) {
-					for (int ix = x; ix < end_x; ix++) {
-						if (!(current_face == faces[end_y][ix]))
-							goto bail;
-					}
-
-					for (int ix = x; ix < end_x; ix++) {
-						faces[end_y][ix].present = false;
-					}
-				}
-			bail:
+void VoxelChunk::draw(CMatRenderContextPtr& pRenderContext) {
+	if (meshes.empty())
+		return;
 
-				current_face.present = false;
+	// Vertices are chunk local and in voxels, this puts them in place
+	float scale = system->config.scale;
 
-				int w = end_x - x;
-				int h = end_y - y;
+	pRenderContext->MatrixMode(MATERIAL_MODEL);
+	pRenderContext->PushMatrix();
+	pRenderContext->Translate(posX*VOXEL_CHUNK_SIZE*scale, posY*VOXEL_CHUNK_SIZE*scale, posZ*VOXEL_CHUNK_SIZE*scale);
+	pRenderContext->Scale(scale, scale, scale);
 
-#ifdef VOXELATE_CLIENT
-				addSliceFace(slice, x, y, w, h, current_face.texture.x, current_face.texture.y, current_face.direction ? dir : dir+3);
-#else
-				addSliceFace(slice, x, y, w, h, 0, 0, dir);
-#endif
-			}
-		}
+	for (VoxelPooledMesh& m : meshes) {
+		m.mesh->Draw();
 	}
-}
 
-void VoxelChunk::draw(CMatRenderContextPtr& pRenderContext) {
-	for (IMesh* m : meshes) {
-		m->Draw();
-	}
+	pRenderContext->PopMatrix();
 }
 
 XYZCoordinate VoxelChunk::getWorldCoords() {
@@ -1287,11 +2563,18 @@ XYZCoordinate VoxelChunk::getWorldCoords() {
 }
 
 BlockData VoxelChunk::get(Coord x, Coord y, Coord z) {
-	return voxel_data[x + y*VOXEL_CHUNK_SIZE + z*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
+	return voxel_data->get(x + y*VOXEL_CHUNK_SIZE + z*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE);
 }
 
 void VoxelChunk::set(Coord x, Coord y, Coord z, BlockData d, bool flagChunks) {
-	voxel_data[x + y*VOXEL_CHUNK_SIZE + z*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE] = d;
+	writeData().set(x + y*VOXEL_CHUNK_SIZE + z*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE, d);
+	version++;
+
+	// Placing something solid can only make us non-empty. Removing something needs a proper look.
+	if (system->config.voxelTypes[d].form == VFORM_CUBE)
+		empty = false;
+	else if (!empty)
+		updateEmpty();
 
 	if (!flagChunks)
 		return;
@@ -1311,6 +2594,56 @@ void VoxelChunk::set(Coord x, Coord y, Coord z, BlockData d, bool flagChunks) {
 	}
 
 }
+
+void VoxelChunk::setAll(const BlockData* values) {
+	// Everything gets replaced, so there's nothing worth copying
+	writeData(false).pack(values);
+	version++;
+	updateEmpty();
+}
+
+PalettedBlockStorage& VoxelChunk::writeData(bool keep_voxels) {
+	// Only the game thread hands out references. If we're the only one left, nobody else can start reading.
+	if (voxel_data.use_count() != 1)
+		voxel_data = keep_voxels ? std::make_shared<PalettedBlockStorage>(*voxel_data) : std::make_shared<PalettedBlockStorage>();
+	else
+		std::atomic_thread_fence(std::memory_order_acquire); // Whoever let go last is done reading before we write
+
+	return *voxel_data;
+}
+
+int VoxelChunk::getCachedCompressed(const char*& data) {
+	if (!compressed_valid || compressed_version != version)
+		return 0;
+
+	data = compressed.data();
+	return compressed.size();
+}
+
+int VoxelChunk::getCompressed(const char*& data) {
+	if (!compressed_valid || compressed_version != version) {
+		BlockData raw[VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
+		voxel_data->unpack(raw);
+
+		char buffer[CODEC_MAX_COMPRESSED_SIZE];
+		int size = voxCompress(system->config.codec, raw, buffer);
+
+		compressed.assign(buffer, buffer + size);
+		compressed_version = version;
+		compressed_valid = true;
+	}
+
+	data = compressed.data();
+	return compressed.size();
+}
+
+void VoxelChunk::updateEmpty() {
+	VoxelType* types = system->config.voxelTypes;
+
+	empty = !voxel_data->anyOf([types](BlockData d) {
+		return types[d].form == VFORM_CUBE;
+	});
+}
 /*
 void VoxelChunk::send(int sys_index, int ply_id, bool init, int chunk_num) {
 	net_sv_sendChunk(sys_index, ply_id, init, chunk_num , voxel_data, (VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE)*2);
@@ -1318,12 +2651,10 @@ void VoxelChunk::send(int sys_index, int ply_id, bool init, int chunk_num) {
 */
 void VoxelChunk::meshClearAll() {
 	if (!IS_SERVERSIDE) {
-		CMatRenderContextPtr pRenderContext(IFACE_CL_MATERIALS);
+		for (VoxelPooledMesh& mesh : meshes)
+			system->mesh_pool.release(mesh);
 
-		while (meshes.begin() != meshes.end()) {
-			pRenderContext->DestroyStaticMesh(*meshes.begin());
-			meshes.erase(meshes.begin());
-		}
+		meshes.clear();
 	}
 	else {
 		if (phys_obj!=nullptr) {
@@ -1341,519 +2672,36 @@ void VoxelChunk::meshClearAll() {
 	}
 }
 
+// The rest is physics only, render meshes get filled all at once by uploadMesh.
 void VoxelChunk::meshStart() {
-	if (!IS_SERVERSIDE) {
-		verts_remaining = BUILD_MAX_VERTS;
-
-		CMatRenderContextPtr pRenderContext(IFACE_CL_MATERIALS);
-		current_mesh = pRenderContext->CreateStaticMesh(VOXEL_VERT_FMT, "");
-
-		meshBuilder.Begin(current_mesh, MATERIAL_QUADS, BUILD_MAX_VERTS / 4);
-	}
-	else {
-		phys_soup = IFACE_SV_COLLISION->PolysoupCreate();
-	}
+	phys_soup = IFACE_SV_COLLISION->PolysoupCreate();
 }
 
 void VoxelChunk::meshStop(CBaseEntity* ent) {
-	if (!IS_SERVERSIDE) {
-		if (current_mesh == nullptr)
-			return;
-
-		meshBuilder.End();
-		
-		meshes.push_back(current_mesh);
-		current_mesh = nullptr;
-		
-		verts_remaining = 0;
-	}
-	else {
-		if (phys_soup == nullptr)
-			return;
+	if (phys_soup == nullptr)
+		return;
 
-		phys_collider = IFACE_SV_COLLISION->ConvertPolysoupToCollide(phys_soup, false); //todo what the fuck is MOPP?
-		IFACE_SV_COLLISION->PolysoupDestroy(phys_soup);
-		phys_soup = nullptr;
+	phys_collider = IFACE_SV_COLLISION->ConvertPolysoupToCollide(phys_soup, false); //todo what the fuck is MOPP?
+	IFACE_SV_COLLISION->PolysoupDestroy(phys_soup);
+	phys_soup = nullptr;
 
-		objectparams_t op = { 0 };
-		op.enableCollisions = true;
-		op.pGameData = static_cast<void *>(ent);
-		op.pName = "voxels";
+	objectparams_t op = { 0 };
+	op.enableCollisions = true;
+	op.pGameData = static_cast<void *>(ent);
+	op.pName = "voxels";
 
-		Vector pos = eent_getPos(ent);
+	Vector pos = eent_getPos(ent);
 
-		IPhysicsEnvironment* env = IFACE_SV_PHYSICS->GetActiveEnvironmentByIndex(0);
-		phys_obj = env->CreatePolyObjectStatic(phys_collider, 3, pos, QAngle(0, 0, 0), &op);
-	}
+	IPhysicsEnvironment* env = IFACE_SV_PHYSICS->GetActiveEnvironmentByIndex(0);
+	phys_obj = env->CreatePolyObjectStatic(phys_collider, 3, pos, QAngle(0, 0, 0), &op);
 }
 
-void VoxelChunk::addFullVoxelFace(Coord x, Coord y, Coord z, int tx, int ty, byte dir) {
-	double realX = (x + posX*VOXEL_CHUNK_SIZE) * system->config.scale;
-	double realY = (y + posY*VOXEL_CHUNK_SIZE) * system->config.scale;
-	double realZ = (z + posZ*VOXEL_CHUNK_SIZE) * system->config.scale;
-
-	double realStep = system->config.scale;
-
-	if (!IS_SERVERSIDE) {
-		if (verts_remaining < 4) {
-			meshStop(nullptr);
-			meshStart();
-		}
-		verts_remaining -= 4;
-
-		VoxelConfig* cl_config = &(system->config);
-
-		double uMin = ((double)tx / cl_config->atlasWidth) + cl_config->_padding_x;
-		double uMax = ((tx + 1.0) / cl_config->atlasWidth) - cl_config->_padding_x;
-
-		double vMin = ((double)ty / cl_config->atlasHeight) + cl_config->_padding_y;
-		double vMax = ((ty + 1.0) / cl_config->atlasHeight) - cl_config->_padding_y;
-
-		if (dir == DIR_X_POS) {
-			meshBuilder.Position3f(realX + realStep, realY, realZ);
-			meshBuilder.TexCoord2f(0, uMin, vMax);
-			meshBuilder.Normal3f(1, 0, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY, realZ + realStep);
-			meshBuilder.TexCoord2f(0, uMin, vMin);
-			meshBuilder.Normal3f(1, 0, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY + realStep, realZ + realStep);
-			meshBuilder.TexCoord2f(0, uMax, vMin);
-			meshBuilder.Normal3f(1, 0, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY + realStep, realZ);
-			meshBuilder.TexCoord2f(0, uMax, vMax);
-			meshBuilder.Normal3f(1, 0, 0);
-			meshBuilder.AdvanceVertex();
-		}
-		else if (dir == DIR_X_NEG) {
-			meshBuilder.Position3f(realX + realStep, realY, realZ);
-			meshBuilder.TexCoord2f(0, uMax, vMax);
-			meshBuilder.Normal3f(-1, 0, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY + realStep, realZ);
-			meshBuilder.TexCoord2f(0, uMin, vMax);
-			meshBuilder.Normal3f(-1, 0, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY + realStep, realZ + realStep);
-			meshBuilder.TexCoord2f(0, uMin, vMin);
-			meshBuilder.Normal3f(-1, 0, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY, realZ + realStep);
-			meshBuilder.TexCoord2f(0, uMax, vMin);
-			meshBuilder.Normal3f(-1, 0, 0);
-			meshBuilder.AdvanceVertex();
-		}
-		else if (dir == DIR_Y_POS) {
-			meshBuilder.Position3f(realX, realY + realStep, realZ);
-			meshBuilder.TexCoord2f(0, uMax, vMax);
-			meshBuilder.Normal3f(0, 1, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY + realStep, realZ);
-			meshBuilder.TexCoord2f(0, uMin, vMax);
-			meshBuilder.Normal3f(0, 1, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY + realStep, realZ + realStep);
-			meshBuilder.TexCoord2f(0, uMin, vMin);
-			meshBuilder.Normal3f(0, 1, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX, realY + realStep, realZ + realStep);
-			meshBuilder.TexCoord2f(0, uMax, vMin);
-			meshBuilder.Normal3f(0, 1, 0);
-			meshBuilder.AdvanceVertex();
-		}
-		else if (dir == DIR_Y_NEG) {
-			meshBuilder.Position3f(realX, realY + realStep, realZ);
-			meshBuilder.TexCoord2f(0, uMin, vMax);
-			meshBuilder.Normal3f(0, -1, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX, realY + realStep, realZ + realStep);
-			meshBuilder.TexCoord2f(0, uMin, vMin);
-			meshBuilder.Normal3f(0, -1, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY + realStep, realZ + realStep);
-			meshBuilder.TexCoord2f(0, uMax, vMin);
-			meshBuilder.Normal3f(0, -1, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY + realStep, realZ);
-			meshBuilder.TexCoord2f(0, uMax, vMax);
-			meshBuilder.Normal3f(0, -1, 0);
-			meshBuilder.AdvanceVertex();
-		}
-		else if (dir == DIR_Z_POS) {
-			meshBuilder.Position3f(realX, realY, realZ + realStep);
-			meshBuilder.TexCoord2f(0, uMin, vMax);
-			meshBuilder.Normal3f(0, 0, 1);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX, realY + realStep, realZ + realStep);
-			meshBuilder.TexCoord2f(0, uMin, vMin);
-			meshBuilder.Normal3f(0, 0, 1);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY + realStep, realZ + realStep);
-			meshBuilder.TexCoord2f(0, uMax, vMin);
-			meshBuilder.Normal3f(0, 0, 1);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY, realZ + realStep);
-			meshBuilder.TexCoord2f(0, uMax, vMax);
-			meshBuilder.Normal3f(0, 0, 1);
-			meshBuilder.AdvanceVertex();
-		}
-		else if (dir == DIR_Z_NEG) {
-			meshBuilder.Position3f(realX, realY, realZ + realStep);
-			meshBuilder.TexCoord2f(0, uMin, vMax);
-			meshBuilder.Normal3f(0, 0, -1);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY, realZ + realStep);
-			meshBuilder.TexCoord2f(0, uMax, vMax);
-			meshBuilder.Normal3f(0, 0, -1);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY + realStep, realZ + realStep);
-			meshBuilder.TexCoord2f(0, uMax, vMin);
-			meshBuilder.Normal3f(0, 0, -1);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX, realY + realStep, realZ + realStep);
-			meshBuilder.TexCoord2f(0, uMin, vMin);
-			meshBuilder.Normal3f(0, 0, -1);
-			meshBuilder.AdvanceVertex();
-		}
-	}
-	else {
-		Vector v1, v2, v3, v4;
-		if (dir == DIR_X_POS) {
-			v1 = Vector(realX + realStep, realY, realZ);
-			v2 = Vector(realX + realStep, realY, realZ + realStep);
-			v3 = Vector(realX + realStep, realY + realStep, realZ + realStep);
-			v4 = Vector(realX + realStep, realY + realStep, realZ);
-		}
-		else if (dir == DIR_X_NEG) {
-			v1 = Vector(realX + realStep, realY, realZ);
-			v2 = Vector(realX + realStep, realY + realStep, realZ);
-			v3 = Vector(realX + realStep, realY + realStep, realZ + realStep);
-			v4 = Vector(realX + realStep, realY, realZ + realStep);
-		}
-		else if (dir == DIR_Y_POS) {
-			v1 = Vector(realX, realY + realStep, realZ);
-			v2 = Vector(realX + realStep, realY + realStep, realZ);
-			v3 = Vector(realX + realStep, realY + realStep, realZ + realStep);
-			v4 = Vector(realX, realY + realStep, realZ + realStep);
-		}
-		else if (dir == DIR_Y_NEG) {
-			v1 = Vector(realX, realY + realStep, realZ);
-			v2 = Vector(realX, realY + realStep, realZ + realStep);
-			v3 = Vector(realX + realStep, realY + realStep, realZ + realStep);
-			v4 = Vector(realX + realStep, realY + realStep, realZ);
-		}
-		else if (dir == DIR_Z_POS) {
-			v1 = Vector(realX, realY, realZ + realStep);
-			v2 = Vector(realX, realY + realStep, realZ + realStep);
-			v3 = Vector(realX + realStep, realY + realStep, realZ + realStep);
-			v4 = Vector(realX + realStep, realY, realZ + realStep);
-		}
-		else if (dir == DIR_Z_NEG) {
-			v1 = Vector(realX, realY, realZ + realStep);
-			v2 = Vector(realX + realStep, realY, realZ + realStep);
-			v3 = Vector(realX + realStep, realY + realStep, realZ + realStep);
-			v4 = Vector(realX, realY + realStep, realZ + realStep);
-		}
-
-		if (phys_soup == nullptr) {
-			meshStart();
-		}
-
-		IFACE_SV_COLLISION->PolysoupAddTriangle(phys_soup, v1, v2, v3, 3);
-		IFACE_SV_COLLISION->PolysoupAddTriangle(phys_soup, v1, v3, v4, 3);
+void VoxelChunk::addSliceFace(const VoxelQuad& quad) {
+	if (phys_soup == nullptr) {
+		meshStart();
 	}
-}
-
-void VoxelChunk::addSliceFace(int slice, int x, int y, int w, int h, int tx, int ty, byte dir) {
-
-	double realStep = system->config.scale;
-
-	if (!IS_SERVERSIDE) {
-		if (verts_remaining < 4) {
-			meshStop(nullptr);
-			meshStart();
-		}
-		verts_remaining -= 4;
-
-		VoxelConfig* cl_config = &(system->config);
-
-		double uMin = ((double)tx / cl_config->atlasWidth) + cl_config->_padding_x;
-		double uMax = ((tx + 1.0) / cl_config->atlasWidth) - cl_config->_padding_x;
-
-		double vMin = ((double)ty / cl_config->atlasHeight) + cl_config->_padding_y;
-		double vMax = ((ty + 1.0) / cl_config->atlasHeight) - cl_config->_padding_y;
-
-		double realX;
-		double realY;
-		double realZ;
-
-		switch (dir) {
-
-		case DIR_X_POS:
-
-			realX = (slice + posX*VOXEL_CHUNK_SIZE) * system->config.scale;
-			realY = (x + posY*VOXEL_CHUNK_SIZE) * system->config.scale;
-			realZ = (y + posZ*VOXEL_CHUNK_SIZE) * system->config.scale;
-
-			meshBuilder.Position3f(realX + realStep, realY, realZ);
-			meshBuilder.TexCoord2f(0, 0, h);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(1, 0, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY, realZ + realStep * h);
-			meshBuilder.TexCoord2f(0, 0, 0);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(1, 0, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY + realStep * w, realZ + realStep * h);
-			meshBuilder.TexCoord2f(0, w, 0);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(1, 0, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY + realStep * w, realZ);
-			meshBuilder.TexCoord2f(0, w, h);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(1, 0, 0);
-			meshBuilder.AdvanceVertex();
-			
-			break;
-
-		case DIR_X_NEG:
-
-			realX = (slice + posX*VOXEL_CHUNK_SIZE) * system->config.scale;
-			realY = (x + posY*VOXEL_CHUNK_SIZE) * system->config.scale;
-			realZ = (y + posZ*VOXEL_CHUNK_SIZE) * system->config.scale;
-
-			meshBuilder.Position3f(realX + realStep, realY, realZ);
-			meshBuilder.TexCoord2f(0, w, h);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(-1, 0, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY + realStep * w, realZ);
-			meshBuilder.TexCoord2f(0, 0, h);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(-1, 0, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY + realStep * w, realZ + realStep * h);
-			meshBuilder.TexCoord2f(0, 0, 0);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(-1, 0, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep, realY, realZ + realStep * h);
-			meshBuilder.TexCoord2f(0, w, 0);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(-1, 0, 0);
-			meshBuilder.AdvanceVertex();
-			
-			break;
-
-		case DIR_Y_POS:
-
-			realX = (x + posX*VOXEL_CHUNK_SIZE) * system->config.scale;
-			realY = (slice + posY*VOXEL_CHUNK_SIZE) * system->config.scale;
-			realZ = (y + posZ*VOXEL_CHUNK_SIZE) * system->config.scale;
-
-			meshBuilder.Position3f(realX, realY + realStep, realZ);
-			meshBuilder.TexCoord2f(0, w, h);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(0, 1, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep * w, realY + realStep, realZ);
-			meshBuilder.TexCoord2f(0, 0, h);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(0, 1, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep * w, realY + realStep, realZ + realStep * h);
-			meshBuilder.TexCoord2f(0, 0, 0);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(0, 1, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX, realY + realStep, realZ + realStep * h);
-			meshBuilder.TexCoord2f(0, w, 0);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(0, 1, 0);
-			meshBuilder.AdvanceVertex();
-
-			break;
-		
-		case DIR_Y_NEG:
-
-			realX = (x + posX*VOXEL_CHUNK_SIZE) * system->config.scale;
-			realY = (slice + posY*VOXEL_CHUNK_SIZE) * system->config.scale;
-			realZ = (y + posZ*VOXEL_CHUNK_SIZE) * system->config.scale;
-
-			meshBuilder.Position3f(realX, realY + realStep, realZ);
-			meshBuilder.TexCoord2f(0, 0, h);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(0, -1, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX, realY + realStep, realZ + realStep * h);
-			meshBuilder.TexCoord2f(0, 0, 0);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(0, -1, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep * w, realY + realStep, realZ + realStep * h);
-			meshBuilder.TexCoord2f(0, w, 0);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(0, -1, 0);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep * w, realY + realStep, realZ);
-			meshBuilder.TexCoord2f(0, w, h);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(0, -1, 0);
-			meshBuilder.AdvanceVertex();
-
-			break;
-
-		case DIR_Z_POS:
-
-			realX = (x + posX*VOXEL_CHUNK_SIZE) * system->config.scale;
-			realY = (y + posY*VOXEL_CHUNK_SIZE) * system->config.scale;
-			realZ = (slice + posZ*VOXEL_CHUNK_SIZE) * system->config.scale;
-
-			meshBuilder.Position3f(realX, realY, realZ + realStep);
-			meshBuilder.TexCoord2f(0, 0, h);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(0, 0, 1);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX, realY + realStep * h, realZ + realStep);
-			meshBuilder.TexCoord2f(0, 0, 0);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(0, 0, 1);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep * w, realY + realStep * h, realZ + realStep);
-			meshBuilder.TexCoord2f(0, w, 0);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(0, 0, 1);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep * w, realY, realZ + realStep);
-			meshBuilder.TexCoord2f(0, w, h);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(0, 0, 1);
-			meshBuilder.AdvanceVertex();
-
-			break;
-
-		case DIR_Z_NEG:
-
-			realX = (x + posX*VOXEL_CHUNK_SIZE) * system->config.scale;
-			realY = (y + posY*VOXEL_CHUNK_SIZE) * system->config.scale;
-			realZ = (slice + posZ*VOXEL_CHUNK_SIZE) * system->config.scale;
-
-			meshBuilder.Position3f(realX, realY, realZ + realStep);
-			meshBuilder.TexCoord2f(0, 0, h);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(0, 0, -1);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep * w, realY, realZ + realStep);
-			meshBuilder.TexCoord2f(0, w, h);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(0, 0, -1);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX + realStep * w, realY + realStep * h, realZ + realStep);
-			meshBuilder.TexCoord2f(0, w, 0);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(0, 0, -1);
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f(realX, realY + realStep * h, realZ + realStep);
-			meshBuilder.TexCoord2f(0, 0, 0);
-			meshBuilder.TexCoord2f(1, uMin, vMin);
-			meshBuilder.Normal3f(0, 0, -1);
-			meshBuilder.AdvanceVertex();
-
-			break;
-		}
-	} else {
-		double realX;
-		double realY;
-		double realZ;
-
-		Vector v1, v2, v3, v4;
-		switch (dir) {
-
-		case DIR_X_POS:
-
-			realX = (slice + posX*VOXEL_CHUNK_SIZE) * system->config.scale;
-			realY = (x + posY*VOXEL_CHUNK_SIZE) * system->config.scale;
-			realZ = (y + posZ*VOXEL_CHUNK_SIZE) * system->config.scale;
-
-			v1 = Vector(realX + realStep, realY, realZ);
-			v2 = Vector(realX + realStep, realY, realZ + realStep * h);
-			v3 = Vector(realX + realStep, realY + realStep * w, realZ + realStep * h);
-			v4 = Vector(realX + realStep, realY + realStep * w, realZ);
-			break;
-
-		case DIR_Y_POS:
-
-			realX = (x + posX*VOXEL_CHUNK_SIZE) * system->config.scale;
-			realY = (slice + posY*VOXEL_CHUNK_SIZE) * system->config.scale;
-			realZ = (y + posZ*VOXEL_CHUNK_SIZE) * system->config.scale;
-
-			v1 = Vector(realX, realY + realStep, realZ);
-			v2 = Vector(realX + realStep * w, realY + realStep, realZ);
-			v3 = Vector(realX + realStep * w, realY + realStep, realZ + realStep * h);
-			v4 = Vector(realX, realY + realStep, realZ + realStep * h);
-			break;
-
-		case DIR_Z_POS:
-
-			realX = (x + posX*VOXEL_CHUNK_SIZE) * system->config.scale;
-			realY = (y + posY*VOXEL_CHUNK_SIZE) * system->config.scale;
-			realZ = (slice + posZ*VOXEL_CHUNK_SIZE) * system->config.scale;
-
-			v1 = Vector(realX, realY, realZ + realStep);
-			v2 = Vector(realX, realY + realStep * h, realZ + realStep);
-			v3 = Vector(realX + realStep * w, realY + realStep * h, realZ + realStep);
-			v4 = Vector(realX + realStep * w, realY, realZ + realStep);
-			break;
-
-		default:
-			return;
-		}
-
-		if (phys_soup == nullptr) {
-			meshStart();
-		}
 
+	emitQuadTriangles([this](const Vector& v1, const Vector& v2, const Vector& v3) {
 		IFACE_SV_COLLISION->PolysoupAddTriangle(phys_soup, v1, v2, v3, 3);
-		IFACE_SV_COLLISION->PolysoupAddTriangle(phys_soup, v1, v3, v4, 3);
-	}
+	}, quad, system->config, { posX, posY, posZ });
 }
\ No newline at end of file
@@ -9,17 +9,30 @@
 #include <vector>
 #include <string>
 #include <deque>
+#include <memory>
+#include <mutex>
+#include <bitset>
 
 #include "materialsystem/imesh.h"
 
 #include "glua.h"
 
 #include "vox_util.h"
+#include "vox_threadpool.h"
+#include "vox_blockstorage.h"
+#include "vox_chunkindex.h"
+#include "vox_chunkstream.h"
+#include "vox_codec.h"
+#include "vox_worldgen.h"
+#include "vox_meshpool.h"
 
 typedef uint16 BlockData;
 typedef std::int32_t Coord;
 typedef std::array<Coord, 3> XYZCoordinate;
 
+// Bulk edits turn down anything past this, on any axis. Leaves enough room for coordinates to be added together without overflowing.
+#define VOXEL_COORD_LIMIT (1 << 30)
+
 // custom specialization of std::hash can be injected in namespace std
 // thanks zerf
 namespace std {
@@ -41,6 +54,14 @@ namespace std {
 
 #define VOXEL_CHUNK_SIZE 16
 
+#define DIR_X_POS 1
+#define DIR_Y_POS 2
+#define DIR_Z_POS 3
+
+#define DIR_X_NEG 4
+#define DIR_Y_NEG 5
+#define DIR_Z_NEG 6
+
 class CPhysPolysoup;
 class IPhysicsObject;
 class CPhysCollide;
@@ -71,6 +92,10 @@ struct VoxelTraceRes {
 	double fraction = -1;
 	Vector hitPos;
 	Vector hitNormal = Vector(0,0,0);
+
+	// Gave up after too many steps, counts as a miss. Traces can run on workers, so whoever called them reports it.
+	bool bailed = false;
+
 	VoxelTraceRes& operator*(double n) { hitPos *= n; return *this; }
 };
 
@@ -90,6 +115,20 @@ struct VoxelConfig {
 	bool buildPhysicsMesh = false;
 	bool buildExterior = false;
 
+	// What chunks get compressed with, for the network and saves. See vox_codec.h
+	VoxelCodec codec = VCODEC_DEFAULT;
+
+	// What new chunks get filled with. See vox_worldgen.h
+	VoxelGenerator generator = VGEN_DEFAULT;
+
+	// How far each peer can see, in chunks. They get sent chunks within viewRadius, and told to unload them
+	// once they're further than viewRadius + viewHysteresis. 0 sends everything.
+	int viewRadius = 0;
+	int viewHysteresis = 2;
+
+	// Huge worlds only: how many chunks the server keeps loaded before it starts evicting ones nobody can see.
+	int maxLoadedChunks = 8192;
+
 	IMaterial* atlasMaterial = nullptr;
 
 	int atlasWidth = 1;
@@ -104,6 +143,23 @@ struct VoxelConfig {
 class VoxelWorld;
 class VoxelChunk;
 
+struct VoxelMeshInput;
+struct VoxelQuad;
+struct VoxelMeshJob;
+
+class bf_read;
+class ChunkSetSender;
+class VoxelRegionStore;
+struct VoxelSaveJob;
+struct VoxelLoadJob;
+struct VoxelStreamLoad;
+
+enum VoxelPersistKind {
+	VPERSIST_NONE,
+	VPERSIST_SAVE,
+	VPERSIST_LOAD
+};
+
 int newIndexedVoxelWorld(int index, VoxelConfig& config);
 
 VoxelWorld* getIndexedVoxelWorld(int index);
@@ -127,9 +183,23 @@ public:
 	const int getChunkData(Coord x, Coord y, Coord z, char * out);
 	bool setChunkData(Coord x, Coord y, Coord z, const char* data_compressed, int data_len);
 
-	bool loadFromString(std::string contents);
+	// Saves go in region files in dir, see vox_regionfile.h. The directory has to exist already.
+	// Only chunks that changed since the last save or load get written, unless dir is a different directory than last time.
+	// Returns right away, the compressing and writing happens on the I/O thread. Edits can keep going meanwhile,
+	// the save gets what the world looked like when it started. False if a save or load is already running.
+	bool save(const std::string& dir);
+
+	// Replaces every loaded chunk with what's saved in dir, chunks it doesn't have get generated again.
+	// Huge worlds keep loading chunks from there as they're needed. Do this before anyone's been sent anything.
+	// Chunks are read on the I/O thread and put in the world a few batches per doUpdates. False if a save or load is already running.
+	bool load(const std::string& dir);
+
+	// Blocks until the running save or load is completely done.
+	void waitForPersistence();
 
-	std::tuple<char*, size_t> writeToString();
+	// Progress of the running or just finished save or load. False if there's nothing to report.
+	// Once it's reported as finished it's forgotten. loaded is how many chunks a load found in the save.
+	bool getPersistStatus(VoxelPersistKind& kind, int& done, int& total, bool& finished, bool& ok, int& loaded);
 
 	void initialize();
 
@@ -140,15 +210,40 @@ public:
 
 #ifdef VOXELATE_SERVER
 	bool sendChunk(int peerID, XYZCoordinate pos);
-	bool sendChunksAround(int peerID, XYZCoordinate pos, Coord radius = 10);
+	// packet_size 0 = default, about 16KB a packet
+	bool sendChunksAround(int peerID, XYZCoordinate pos, Coord radius = 10, int packet_size = 0);
+
+	// Keeps a peer sent every chunk within its view radius over a bunch of ticks, nearest to origin first. Origin is in local coordinates,
+	// like getAllChunkPositions. Call streamUpdate every tick with wherever the peer is now, for as long as it's around. It sends newly visible
+	// chunks, unloads ones that went out of view, and returns how many chunks are still queued. On huge worlds, chunks that aren't loaded
+	// get loaded on the thread pool, and go out once they're ready. Those count as queued too.
+	void streamStart(int peerID, Vector origin);
+	int streamUpdate(int peerID, Vector origin, int byte_budget);
+	void streamStop(int peerID);
+
+	// Every set and fill on the server goes in a journal, one entry per chunk, with later writes to a voxel replacing earlier ones.
+	// flushEdits turns the journal into one edit packet per chunk and clears it, false if nothing changed.
+	// sendEdits sends the packets from the last flush to a peer, skipping chunks the peer hasn't been streamed. Flush once a tick, then send to everyone.
+	bool flushEdits();
+	void sendEdits(int peerID);
+#endif
+
+#ifdef VOXELATE_CLIENT
+	// Reads the rest of an edit packet, see flushEdits for the format.
+	bool applyEdits(bf_read& reader);
 #endif
 
 	void sortUpdatesByDistance(Vector * origin);
-	void doUpdates(int count, CBaseEntity * ent);
+	void doUpdates(double time_budget, CBaseEntity * ent);
 
 	VoxelTraceRes doTrace(Vector startPos, Vector delta);
 	VoxelTraceRes doTraceHull(Vector startPos, Vector delta, Vector extents);
 
+	// Runs a batch of traces in one go. Each trace reads 6 floats from in (start xyz, delta xyz) and writes 7 to out
+	// (fraction, hit position xyz, hit normal xyz), fraction is -1 for a miss. Buffers don't need to be aligned.
+	// With parallel set the batch gets split over the thread pool, but this still doesn't return until every trace is done.
+	void doTraceMany(const unsigned char* in, unsigned char* out, int count, bool hull, Vector extents, bool parallel);
+
 	VoxelTraceRes iTrace(Vector startPos, Vector delta, Vector defNormal);
 	VoxelTraceRes iTraceHull(Vector startPos, Vector delta, Vector extents, Vector defNormal);
 
@@ -157,39 +252,166 @@ public:
 	BlockData get(Coord x, Coord y, Coord z);
 	bool set(Coord x, Coord y, Coord z, BlockData d,bool flagChunks=true);
 
+	// Bulk edits, done a chunk at a time with whole rows filled at once. Each chunk touched gets flagged once, not once per voxel.
+	// Region bounds are inclusive. Both return true if anything was set.
+	// Fills that reach past VOXEL_COORD_LIMIT get turned down. So do fills on huge worlds whose bounds cover more than maxLoadedChunks chunks,
+	// since the server has to load each one.
+	bool fillRegion(Coord min_x, Coord min_y, Coord min_z, Coord max_x, Coord max_y, Coord max_z, BlockData d);
+	bool fillSphere(Coord x, Coord y, Coord z, Coord r, BlockData d);
+
+	// Deletes a chunk, for clients once it's out of view. False if it wasn't loaded.
+	bool unloadChunk(Coord x, Coord y, Coord z);
+
+	// Huge worlds on the server: loads chunks that got evicted or saved, generates ones that never existed, and evicts ones nobody can see
+	// once there's more than maxLoadedChunks. Call evictChunks once a tick, voxUpdate does.
+	VoxelChunk* loadChunk(Coord x, Coord y, Coord z);
+	void evictChunks();
+
 	//bool trackUpdates = false;
 	//std::vector<XYZCoordinate> queued_block_updates;
 private:
 	//bool initialised = false;
 
-	std::unordered_map<XYZCoordinate, VoxelChunk*> chunks_map; // ok zerf lmao
+	// See vox_chunkindex.h
+	VoxelChunkIndex chunks_map;
 
 	void flagChunk(XYZCoordinate chunk_pos, bool high_priority);
 
+	void generateChunks(const std::vector<VoxelChunk*>& chunks);
+
+	// doTrace and doTraceHull without the bail message, safe to run on workers
+	VoxelTraceRes clipTrace(Vector startPos, Vector delta);
+	VoxelTraceRes clipTraceHull(Vector startPos, Vector delta, Vector extents);
+
+	// Chunk that set and fill should write to. Loads it if this is a huge world on the server.
+	VoxelChunk* getChunkForEdit(Coord x, Coord y, Coord z);
+
+	// Flags a chunk after an edit, plus the neighbors whose meshes share a face with the low sides of it, if those were touched.
+	void flagChunkSides(XYZCoordinate chunk_pos, bool low_x, bool low_y, bool low_z);
+
+	template<typename ChunkHitFn, typename RowSpanFn>
+	bool fillRows(long long box_min_x, long long box_min_y, long long box_min_z, long long box_max_x, long long box_max_y, long long box_max_z, BlockData d,
+		ChunkHitFn chunk_hit, RowSpanFn row_span);
+
 	std::deque<XYZCoordinate> dirty_chunk_queue;
 	std::set<XYZCoordinate> dirty_chunk_set;
 
+	// Meshing jobs, see doUpdates
+	VoxelJobGroup mesh_jobs;
+	int mesh_jobs_in_flight = 0;
+
+	std::deque<VoxelMeshJob*> finished_mesh_jobs;
+	std::mutex finished_mesh_jobs_mutex;
+
+	// Render meshes chunks give back get reused by the next chunk that needs one, see vox_meshpool.h
+	VoxelMeshPool mesh_pool;
+
+#ifdef VOXELATE_SERVER
+	XYZCoordinate getOriginChunk(Vector origin);
+
+	struct PeerView {
+		XYZCoordinate center;
+
+		// Chunks in view -> whether they've been sent yet
+		std::map<XYZCoordinate, bool> chunks;
+
+		// In view but not sent, nearest first. Can have stale entries, check chunks before sending anything.
+		VoxelChunkStream queue;
+
+		// Huge worlds: in view, but not loaded yet. They go in the queue once they are, see requestLoad.
+		int loading = 0;
+	};
+
+	void updateView(PeerView& view, ChunkSetSender& sender);
+	void clearView(PeerView& view);
+
+	// Huge worlds: chunks that come into view get read or generated on the thread pool instead of right there. Chunk key -> ticket of the
+	// load that counts. If loadChunk gets to a chunk first it takes it out of here, and the load gets thrown away when it finishes.
+	std::unordered_map<ChunkKey, std::uint64_t> pending_loads;
+	std::uint64_t last_load_ticket = 0;
+
+	// Requested since the last submitLoads
+	std::vector<XYZCoordinate> load_requests;
+
+	VoxelJobGroup stream_load_jobs;
+	std::deque<std::vector<VoxelStreamLoad>*> finished_loads;
+	std::mutex finished_loads_mutex;
+
+	VoxelChunk* requestLoad(const XYZCoordinate& pos);
+	void submitLoads(const XYZCoordinate& center);
+	void updateLoads();
+	void chunkArrived(VoxelChunk* chunk);
+
+	// Peer ID -> what it can see, see streamStart
+	std::unordered_map<int, PeerView> views;
+
+	struct ChunkEdits {
+		std::bitset<VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE> changed;
+		BlockData values[VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE];
+	};
+
+	// Chunk position -> edits since the last flushEdits
+	std::map<XYZCoordinate, ChunkEdits> edit_journal;
+	std::vector<std::pair<XYZCoordinate, std::string>> edit_packets;
+
+	// Where flushEdits builds each packet. Words, since bf_write wants a dword aligned buffer.
+	std::vector<std::uint32_t> edit_buffer;
+#endif
+
+	// Huge worlds: compressed chunks that got evicted with changes in them, keyed by position.
+	// Only used until the world has somewhere to save to, then they go straight in the region files.
+	std::unordered_map<ChunkKey, std::string> evicted_chunks;
+
+	// Where save and load last pointed, nullptr if neither has been called
+	VoxelRegionStore* save_store = nullptr;
+
+	// Set if a save failed part way, the next one writes everything again
+	bool save_everything = false;
+
+	// At most one of these at a time, see save and load
+	VoxelSaveJob* save_job = nullptr;
+	VoxelLoadJob* load_job = nullptr;
+	VoxelJobGroup persist_jobs;
+
+	void updatePersistence();
+
+	VoxelPersistKind persist_kind = VPERSIST_NONE;
+	int persist_done = 0;
+	int persist_total = 0;
+	bool persist_finished = false;
+	bool persist_ok = false;
+	int persist_loaded = 0;
+	std::uint64_t use_clock = 0;
+
 	VoxelConfig config;
 };
 
-struct SliceFace {
-	bool present;
-#ifdef VOXELATE_CLIENT
-	bool direction;
-	AtlasPos texture;
-
-	bool operator== (const SliceFace& other) const {
-		return
-			present == other.present &&
-			direction == other.direction &&
-			texture.x == other.texture.x &&
-			texture.y == other.texture.y;
-	}
-#else
-	bool operator== (const SliceFace& other) const {
-		return present == other.present;
+// A chunk and the six chunks touching its faces, pinned as they were when it was taken, see VoxelChunk::snapshot.
+// Taken on the game thread. After that any thread can read it without locking anything, while the world keeps changing.
+struct VoxelChunkSnapshot {
+	ChunkDataRef center;
+
+	// -X, +X, -Y, +Y, -Z, +Z. Null for chunks that don't exist, those read as air.
+	ChunkDataRef neighbors[6];
+
+	// The chunk's version when it was taken
+	unsigned int version = 0;
+
+	// Local coordinates, -1 to VOXEL_CHUNK_SIZE. Only one axis can be outside the chunk at a time, edges and corners aren't pinned.
+	BlockData get(int x, int y, int z) const {
+		const PalettedBlockStorage* data = center.get();
+
+		if (x < 0) { data = neighbors[0].get(); x += VOXEL_CHUNK_SIZE; }
+		else if (x >= VOXEL_CHUNK_SIZE) { data = neighbors[1].get(); x -= VOXEL_CHUNK_SIZE; }
+		else if (y < 0) { data = neighbors[2].get(); y += VOXEL_CHUNK_SIZE; }
+		else if (y >= VOXEL_CHUNK_SIZE) { data = neighbors[3].get(); y -= VOXEL_CHUNK_SIZE; }
+		else if (z < 0) { data = neighbors[4].get(); z += VOXEL_CHUNK_SIZE; }
+		else if (z >= VOXEL_CHUNK_SIZE) { data = neighbors[5].get(); z -= VOXEL_CHUNK_SIZE; }
+
+		if (data == nullptr)
+			return 0;
+		return data->get(x + y*VOXEL_CHUNK_SIZE + z*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE);
 	}
-#endif
 };
 
 class VoxelChunk {
@@ -202,32 +424,167 @@ public:
 	void build(CBaseEntity* ent);
 	void draw(CMatRenderContextPtr& pRenderContext);
 
+	// Pins our voxels and our neighbors', see VoxelChunkSnapshot. Game thread only.
+	VoxelChunkSnapshot snapshot();
+
+	// Fills in everything but the voxels, a worker unpacks those from the snapshot with unpackMeshInput.
+	void snapshotForMeshing(VoxelMeshInput& input, VoxelChunkSnapshot& snap);
+	void uploadMesh(const std::vector<VoxelQuad>& quads, CBaseEntity* ent);
+
+	// Bumped every time a mesh job is started, so results from stale jobs can be thrown out
+	int mesh_generation = 0;
+
 	XYZCoordinate getWorldCoords();
 
 	BlockData get(int x, int y, int z);
 	void set(int x, int y, int z, BlockData d, bool flagChunks);
 
+	// Replaces every voxel at once, from a flat array. Doesn't flag anything.
+	void setAll(const BlockData* values);
+
+	// True if nothing in here is solid. Traces skip straight through empty chunks.
+	bool isEmpty() { return empty; }
+
+	// Bumped by every set/setAll. Snapshots remember it, so a snapshot with the same version is still current.
+	unsigned int getVersion() { return version; }
+
+	// Read only, change voxels through set/setAll. The reference is good until the next one of those.
+	const PalettedBlockStorage& getData() const { return *voxel_data; }
+
+	// Keeps the current voxels alive and unchanged for as long as it's held, on any thread. Game thread only to take one.
+	ChunkDataRef getDataRef() const { return voxel_data; }
+
+	// Compressed copy of the voxels, made the first time it's asked for after a change, then shared by every send and save.
+	// Returns the size, data stays valid until the chunk changes.
+	int getCompressed(const char*& data);
+
+	// Same, but never compresses, returns 0 if there's nothing up to date.
+	int getCachedCompressed(const char*& data);
+
 	int posX, posY, posZ;
 
-	BlockData voxel_data[VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE] = {};
+	// Huge worlds, see VoxelWorld::evictChunks.
+	// How many peers have this in view, when it was last in view or edited, and the version that can be gotten back without saving it.
+	int viewers = 0;
+	std::uint64_t last_used = 0;
+	unsigned int saved_version = 0;
 private:
+	// Gets the voxels ready to be changed, copying them first if anything else still holds them.
+	// Without keep_voxels a shared copy gets swapped for an empty one, for when everything's about to be overwritten anyway.
+	PalettedBlockStorage& writeData(bool keep_voxels = true);
+
+	// Palette compressed, see vox_blockstorage.h. Never null.
+	std::shared_ptr<PalettedBlockStorage> voxel_data;
+
 	void meshClearAll();
 
 	void meshStart();
 	void meshStop(CBaseEntity* ent);
-	
-	void buildSlice(int slice, byte dir, SliceFace faces[VOXEL_CHUNK_SIZE][VOXEL_CHUNK_SIZE], int upper_bound_x, int upper_bound_y);
 
-	void addFullVoxelFace(int x,int y,int z,int tx, int ty, byte dir);
-	void addSliceFace(int slice, int x, int y, int w, int h, int tx, int ty, byte dir);
+	void addSliceFace(const VoxelQuad& quad);
+
+	void updateEmpty();
+	bool empty = true;
+
+	unsigned int version = 0;
+
+	std::vector<char> compressed;
+	unsigned int compressed_version = 0;
+	bool compressed_valid = false;
 
 	VoxelWorld* system;
 	CMeshBuilder meshBuilder;
-	IMesh* current_mesh = nullptr;
-	std::list<IMesh*> meshes;
-	int verts_remaining = 0;
+	std::vector<VoxelPooledMesh> meshes;
 
 	CPhysPolysoup* phys_soup = nullptr;
 	IPhysicsObject* phys_obj = nullptr;
 	CPhysCollide* phys_collider = nullptr;
+};
+
+// Reads voxels from a world, remembering which chunk it's in.
+// Moving around inside the same chunk is just a bit of math, the chunk only gets looked up again when we cross into another one.
+// Meant for the trace loops, which step one voxel at a time and almost never leave the chunk they're in.
+// Doesn't hold on to anything, but the chunk pointer goes stale if the chunk is deleted, so don't keep one around across updates.
+class VoxelCursor {
+public:
+	VoxelCursor(VoxelWorld* world, Coord x, Coord y, Coord z) {
+		this->world = world;
+		chunk_x = chunkOf(x);
+		chunk_y = chunkOf(y);
+		chunk_z = chunkOf(z);
+		chunk = world->getChunk(chunk_x, chunk_y, chunk_z);
+		local_x = x - chunk_x*VOXEL_CHUNK_SIZE;
+		local_y = y - chunk_y*VOXEL_CHUNK_SIZE;
+		local_z = z - chunk_z*VOXEL_CHUNK_SIZE;
+	}
+
+	void moveTo(Coord x, Coord y, Coord z) {
+		Coord cx = chunkOf(x);
+		Coord cy = chunkOf(y);
+		Coord cz = chunkOf(z);
+
+		if (cx != chunk_x || cy != chunk_y || cz != chunk_z) {
+			chunk_x = cx;
+			chunk_y = cy;
+			chunk_z = cz;
+			chunk = world->getChunk(cx, cy, cz);
+		}
+
+		local_x = x - cx*VOXEL_CHUNK_SIZE;
+		local_y = y - cy*VOXEL_CHUNK_SIZE;
+		local_z = z - cz*VOXEL_CHUNK_SIZE;
+	}
+
+	// Single steps along one axis, step should be 1 or -1
+	void stepX(int step) {
+		local_x += step;
+		if ((unsigned)local_x >= VOXEL_CHUNK_SIZE) {
+			local_x -= step*VOXEL_CHUNK_SIZE;
+			chunk_x += step;
+			chunk = world->getChunk(chunk_x, chunk_y, chunk_z);
+		}
+	}
+
+	void stepY(int step) {
+		local_y += step;
+		if ((unsigned)local_y >= VOXEL_CHUNK_SIZE) {
+			local_y -= step*VOXEL_CHUNK_SIZE;
+			chunk_y += step;
+			chunk = world->getChunk(chunk_x, chunk_y, chunk_z);
+		}
+	}
+
+	void stepZ(int step) {
+		local_z += step;
+		if ((unsigned)local_z >= VOXEL_CHUNK_SIZE) {
+			local_z -= step*VOXEL_CHUNK_SIZE;
+			chunk_z += step;
+			chunk = world->getChunk(chunk_x, chunk_y, chunk_z);
+		}
+	}
+
+	// Missing chunks read as air, same as VoxelWorld::get
+	BlockData get() const {
+		if (chunk == nullptr)
+			return 0;
+		return chunk->getData().get(local_x + local_y*VOXEL_CHUNK_SIZE + local_z*VOXEL_CHUNK_SIZE*VOXEL_CHUNK_SIZE);
+	}
+
+	VoxelChunk* getChunk() const { return chunk; }
+
+	// Position inside the current chunk, 0 to VOXEL_CHUNK_SIZE-1
+	int getLocalX() const { return local_x; }
+	int getLocalY() const { return local_y; }
+	int getLocalZ() const { return local_z; }
+private:
+	// Floored division, the chunk at -1 covers voxels -16 to -1
+	static Coord chunkOf(Coord v) {
+		return v >= 0 ? v / VOXEL_CHUNK_SIZE : (v - VOXEL_CHUNK_SIZE + 1) / VOXEL_CHUNK_SIZE;
+	}
+
+	VoxelWorld* world;
+	VoxelChunk* chunk;
+
+	Coord chunk_x, chunk_y, chunk_z;
+	int local_x, local_y, local_z;
 };
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "vox_worldgen.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define WORLDGEN_LAYER (WORLDGEN_CHUNK_SIZE*WORLDGEN_CHUNK_SIZE)
+#define WORLDGEN_VOXELS (WORLDGEN_LAYER*WORLDGEN_CHUNK_SIZE)
+
+// Block types the terrain generators use, same as vox_worldgen_basic
+#define WORLDGEN_STONE 7
+#define WORLDGEN_DIRT 8
+#define WORLDGEN_GRASS 1
+
+// Value noise: lattice spacing of the first octave, and how tall the hills get
+#define NOISE_CELL 64
+#define NOISE_OCTAVES 4
+#define NOISE_AMPLITUDE 24
+#define NOISE_BASE_HEIGHT 48
+
+const char* voxGeneratorName(VoxelGenerator generator) {
+	switch (generator) {
+	case VGEN_NONE: return "none";
+	case VGEN_BASIC: return "basic";
+	case VGEN_FLAT: return "flat";
+	case VGEN_NOISE: return "noise";
+	default: return "unknown";
+	}
+}
+
+// Sets world z in [from, to) of one column. Voxels are x + y*16 + z*256, so going up a column is a stride of a whole layer.
+static void fillRun(BlockData* out, int column, Coord offset_z, Coord from, Coord to, BlockData value) {
+	int start = std::max(from - offset_z, 0);
+	int end = std::min(to - offset_z, WORLDGEN_CHUNK_SIZE);
+
+	for (int z = start; z < end; z++)
+		out[column + z*WORLDGEN_LAYER] = value;
+}
+
+// Stone up to the bottom of the dirt, 9 dirt, then 1 grass. The grass is at surface - 1.
+static void fillTerrainColumn(BlockData* out, int column, Coord offset_z, Coord surface) {
+	fillRun(out, column, offset_z, offset_z, surface - 10, WORLDGEN_STONE);
+	fillRun(out, column, offset_z, surface - 10, surface - 1, WORLDGEN_DIRT);
+	fillRun(out, column, offset_z, surface - 1, surface, WORLDGEN_GRASS);
+}
+
+static void generateBasic(Coord offset_x, Coord offset_y, Coord offset_z, BlockData* out) {
+	// The hills are sin of x plus cos of y, so one row of each covers the whole chunk.
+	// This is the exact same math as vox_worldgen_basic, just not redone for every voxel.
+	double wave_x[WORLDGEN_CHUNK_SIZE];
+	double wave_y[WORLDGEN_CHUNK_SIZE];
+
+	for (int i = 0; i < WORLDGEN_CHUNK_SIZE; i++) {
+		wave_x[i] = sin((static_cast<double>(offset_x + i) + 30) / 32) * 8;
+		wave_y[i] = cos((static_cast<double>(offset_y + i) - 20) / 32) * 8;
+	}
+
+	for (int y = 0; y < WORLDGEN_CHUNK_SIZE; y++) {
+		for (int x = 0; x < WORLDGEN_CHUNK_SIZE; x++) {
+			Coord height = static_cast<Coord>(floor(wave_x[x] + wave_y[y]));
+			Coord surface = 100 - height;
+
+			int column = x + y*WORLDGEN_CHUNK_SIZE;
+			fillTerrainColumn(out, column, offset_z, surface);
+
+			// That little pad on top of the hills
+			Coord wx = offset_x + x;
+			Coord wy = offset_y + y;
+			if (wx > 315 && wx < 325 && wy > 316 && wy < 324) {
+				bool inner = wx > 316 && wx < 324 && wy > 317 && wy < 323;
+				fillRun(out, column, offset_z, surface, surface + 1, inner ? 6 : 5);
+			}
+		}
+	}
+}
+
+static void generateFlat(Coord /*offset_x*/, Coord /*offset_y*/, Coord offset_z, BlockData* out) {
+	for (int column = 0; column < WORLDGEN_LAYER; column++)
+		fillTerrainColumn(out, column, offset_z, 50);
+}
+
+static std::uint32_t noiseHash(Coord x, Coord y) {
+	std::uint32_t h = static_cast<std::uint32_t>(x) * 0x8da6b343u ^ static_cast<std::uint32_t>(y) * 0xd8163841u;
+	h ^= h >> 15;
+	h *= 0x2c1b3c6du;
+	h ^= h >> 12;
+	h *= 0x297a2d39u;
+	h ^= h >> 15;
+	return h;
+}
+
+// Random value in [-1, 1] at a lattice point
+static double noiseLattice(Coord x, Coord y, int octave) {
+	return (noiseHash(x + octave * 7919, y - octave * 104729) & 0xFFFF) / 32767.5 - 1;
+}
+
+// Coord divided by cell size, rounded down even when negative
+static Coord noiseCellOf(Coord v, Coord cell) {
+	return v >= 0 ? v / cell : -((-v + cell - 1) / cell);
+}
+
+static void generateNoise(Coord offset_x, Coord offset_y, Coord offset_z, BlockData* out) {
+	double height[WORLDGEN_LAYER];
+	std::fill(height, height + WORLDGEN_LAYER, NOISE_BASE_HEIGHT);
+
+	Coord cell = NOISE_CELL;
+	double amplitude = NOISE_AMPLITUDE;
+
+	for (int octave = 0; octave < NOISE_OCTAVES; octave++) {
+		for (int y = 0; y < WORLDGEN_CHUNK_SIZE; y++) {
+			Coord wy = offset_y + y;
+			Coord cy = noiseCellOf(wy, cell);
+			double fy = static_cast<double>(wy - cy*cell) / cell;
+			fy = fy * fy * (3 - 2 * fy);
+
+			for (int x = 0; x < WORLDGEN_CHUNK_SIZE; x++) {
+				Coord wx = offset_x + x;
+				Coord cx = noiseCellOf(wx, cell);
+				double fx = static_cast<double>(wx - cx*cell) / cell;
+				fx = fx * fx * (3 - 2 * fx);
+
+				double n00 = noiseLattice(cx, cy, octave);
+				double n10 = noiseLattice(cx + 1, cy, octave);
+				double n01 = noiseLattice(cx, cy + 1, octave);
+				double n11 = noiseLattice(cx + 1, cy + 1, octave);
+
+				double nx0 = n00 + (n10 - n00) * fx;
+				double nx1 = n01 + (n11 - n01) * fx;
+
+				height[x + y*WORLDGEN_CHUNK_SIZE] += (nx0 + (nx1 - nx0) * fy) * amplitude;
+			}
+		}
+
+		cell = std::max(cell / 2, 1);
+		amplitude /= 2;
+	}
+
+	for (int column = 0; column < WORLDGEN_LAYER; column++)
+		fillTerrainColumn(out, column, offset_z, static_cast<Coord>(floor(height[column])));
+}
+
+void voxGenerateChunk(VoxelGenerator generator, Coord offset_x, Coord offset_y, Coord offset_z, BlockData* out) {
+	// Everything starts as air, generators only fill in the solid runs
+	std::fill(out, out + WORLDGEN_VOXELS, 0);
+
+	switch (generator) {
+	case VGEN_BASIC:
+		generateBasic(offset_x, offset_y, offset_z, out);
+		break;
+	case VGEN_FLAT:
+		generateFlat(offset_x, offset_y, offset_z, out);
+		break;
+	case VGEN_NOISE:
+		generateNoise(offset_x, offset_y, offset_z, out);
+		break;
+	default:
+		break;
+	}
+}
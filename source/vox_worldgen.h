@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+// Same as in vox_voxelworld.h, we can't include that from here.
+typedef std::uint16_t BlockData;
+typedef std::int32_t Coord;
+
+#define WORLDGEN_CHUNK_SIZE 16
+
+// What fills in new chunks. These all work a whole chunk at a time: the terrain height only depends on x and y,
+// so it gets worked out once per column and the column is filled in runs, instead of asking about every voxel.
+enum VoxelGenerator {
+	// Nothing, all air.
+	VGEN_NONE = 0,
+
+	// The old rolling hills, same blocks as vox_worldgen_basic.
+	VGEN_BASIC = 1,
+
+	// Flat ground, grass at z = 49.
+	VGEN_FLAT = 2,
+
+	// A few octaves of value noise for the heightmap, hillier and less regular than basic.
+	VGEN_NOISE = 3,
+
+	VGEN_COUNT
+};
+
+#define VGEN_DEFAULT VGEN_BASIC
+
+const char* voxGeneratorName(VoxelGenerator generator);
+
+// Fills a whole chunk, the offsets are the chunk's first voxel. out is x + y*16 + z*256, same as chunks.
+// Safe to call from any thread, generators don't keep any state.
+void voxGenerateChunk(VoxelGenerator generator, Coord offset_x, Coord offset_y, Coord offset_z, BlockData* out);